@@ -0,0 +1,55 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include "locker.hpp"
+
+// 连接读写缓冲区使用的块池: 块大小按2的幂分级(2KB~64KB), 每级一个全局空闲链表,
+// 每个线程另有一个小缓存, 常见的分配/归还不需要加锁. 连接只在需要时取块, 空闲时归还.
+class buffer_pool {
+public:
+    static const int MIN_SHIFT = 11;        // 最小块2KB
+    static const int CLASSES = 6;           // 2KB, 4KB, ..., 64KB
+    static const size_t MIN_SIZE = (size_t)1 << MIN_SHIFT;
+    static const size_t MAX_SIZE = MIN_SIZE << (CLASSES - 1);
+    static const int LOCAL_CACHE = 64;      // 每级每个线程最多缓存的块数
+
+    static buffer_pool* get_instance() {
+        static buffer_pool instance;
+        return &instance;
+    }
+
+    // 分配不小于size的块, size被改写为实际块大小; size超过MAX_SIZE时返回空
+    char* alloc(size_t& size);
+    // 归还alloc得到的块, size为alloc返回的块大小
+    void free(char* buf, size_t size);
+
+    // 禁止拷贝和赋值
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+private:
+    struct free_list {
+        locker lock;
+        std::vector<char*> blocks;
+    };
+
+    // 线程退出时把缓存的块还给全局链表
+    struct local_cache {
+        std::vector<char*> blocks[CLASSES];
+        ~local_cache();
+    };
+
+    buffer_pool() {}
+    ~buffer_pool();
+
+    static int class_of(size_t size);
+    static local_cache& local();
+
+private:
+    free_list lists_[CLASSES];
+};
+
+#endif // BUFFER_POOL_HPP
@@ -0,0 +1,33 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+
+class Config {
+public:
+    Config();
+    ~Config() {}
+
+    void parse_arg(int argc, char* argv[]);
+
+    int port;           // 端口号
+    int log_write;      // 日志写入方式: 0同步, 1异步
+    int trig_mode;      // 触发组合模式: 0 LT+LT, 1 LT+ET, 2 ET+LT, 3 ET+ET
+    int opt_linger;     // 优雅关闭连接
+    int sql_num;        // 数据库连接池数量
+    int thread_num;     // 线程池内的线程数量(弹性模式下为上限)
+    int min_thread;     // 线程池线程数下限, 小于thread_num时按积压伸缩, 0表示固定为thread_num
+    int close_log;      // 是否关闭日志
+    int actor_model;    // 并发模型选择: 0 proactor, 1 reactor
+    int reactor_num;    // 多reactor模式的事件循环数量, 0表示单事件循环+线程池
+    int io_backend;     // I/O后端: 0 epoll, 1 io_uring, 2 C++20协程(每个连接一个协程)
+    int zero_copy;      // 静态文件发送方式: 0 mmap+writev, 1 sendfile零拷贝
+    int file_cache_mb;  // 静态文件缓存的内存预算(MB), 0表示不缓存
+    int work_stealing;  // 线程池任务分发: 0共享队列, 1每线程双端队列+工作窃取
+    int cpu_affinity;   // 线程绑核: 0不绑, 1按sysfs拓扑绑定事件循环和工作线程, 连接对象放在所在NUMA节点
+    std::string nic;    // 网卡名, 非空时事件循环绑定到该网卡各队列中断所在的CPU
+    int max_conn;       // 连接总数上限, 超过时回复503, 0表示只受最大描述符数限制
+    int queue_deadline_ms;  // 请求在线程池队列中等待超过该毫秒数时回复503并关闭, 0表示不限
+};
+
+#endif // CONFIG_HPP
@@ -0,0 +1,94 @@
+#ifndef CORO_REACTOR_HPP
+#define CORO_REACTOR_HPP
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <atomic>
+#include <vector>
+
+#include "http_conn.hpp"
+#include "sql_connection_pool.hpp"
+#include "timer_wheel.hpp"
+#include "threadpool.hpp"
+#include "mpmc_queue.hpp"
+
+// 以下类型在coro_reactor.cpp中定义, 该文件按C++20编译, 本头文件仍可被C++11代码包含
+struct conn_task;       // 连接协程的返回类型
+struct io_awaiter;      // 等待fd可读/可写
+struct db_call;         // 交给数据库车道执行的一次请求处理, 同时是协程的等待体
+
+// 协程I/O后端: 每个连接是一个协程, 在本事件循环线程的调度器上等待可读/可写事件, 读取、解析、
+// 发送写成顺序代码, 不再经过线程池队列, 也不用EPOLLONESHOT每次重新注册. POST请求的数据库操作交给
+// 本事件循环的数据库车道, 协程挂起等待, 完成后回到本线程继续. 协程帧从线程本地的帧池分配
+class coro_reactor {
+public:
+    static const int MAX_EVENTS = 1024;     // 每轮epoll_wait最多返回的事件数
+    static const int DB_QUEUE = 1024;       // 数据库车道的队列容量
+
+    coro_reactor();
+    ~coro_reactor();
+
+    // db_threads为本事件循环数据库车道的线程数
+    void init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int opt_linger,
+              connection_pool* conn_pool, int db_threads);
+    // 在start之前调用, 含义同uring_reactor::set_cpu
+    void set_cpu(int cpu, bool steer_incoming) { cpu_ = cpu; steer_incoming_ = steer_incoming; }
+    bool start();   // 创建监听socket/epoll并启动线程
+    void stop();    // 通知事件循环退出
+    void join();    // 等待线程退出
+
+    int id() const { return id_; }
+    int user_count() const { return user_count_; }
+    long long request_count() const { return request_count_; }
+
+    // 禁止拷贝和赋值
+    coro_reactor(const coro_reactor&) = delete;
+    coro_reactor& operator=(const coro_reactor&) = delete;
+
+private:
+    friend struct io_awaiter;
+    friend struct db_call;
+
+    static void* worker(void* arg);
+    void run();
+    void deal_client_data();
+    conn_task serve(int fd);        // 连接协程, 连接关闭时结束
+    void resume(void*& waiter);     // 恢复并清空等待槽中的协程
+    void post_ready(void* handle);  // 数据库车道线程调用: 把协程交回本事件循环
+    void drain_ready();
+    void close_conn(int fd);
+
+private:
+    int id_;
+    int port_;
+    int listenfd_;
+    int epollfd_;
+    int wakeup_fd_;         // stop和数据库车道完成时写入, 唤醒epoll_wait
+    pthread_t thread_;
+    int cpu_;               // 绑定的CPU, -1表示不绑核
+    bool steer_incoming_;
+    std::atomic<bool> stop_;
+
+    http_conn* users_;
+    int max_fd_;
+    http_conn::config* conn_config_;    // 全部连接共享的配置
+    int opt_linger_;
+    int close_log_;
+    connection_pool* conn_pool_;
+    int db_threads_;
+
+    // 以fd为下标, 保存协程帧地址(std::coroutine_handle<>::address)
+    std::vector<void*> readers_;    // 等待可读的协程
+    std::vector<void*> writers_;    // 等待可写的协程
+    std::vector<void*> frames_;     // 每个连接的协程, 退出时销毁仍挂起的协程
+    threadpool<db_call>* db_lane_;
+    mpmc_queue<void*> ready_;       // 数据库车道处理完、等待在本线程恢复的协程
+    int offloaded_;                 // 正在数据库车道上的协程数, 仅由本线程修改
+
+    timer_wheel* timers_;       // 本事件循环独占的空闲超时时间轮
+    uint64_t now_ms_;           // 本轮epoll_wait返回时的时间
+    int user_count_;            // 本事件循环的连接数, 仅由本线程修改
+    long long request_count_;   // 本事件循环处理的读事件数
+};
+
+#endif // CORO_REACTOR_HPP
@@ -0,0 +1,53 @@
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// 从sysfs读取的CPU拓扑: 每个可用CPU所在的NUMA节点、物理封装和物理核, 以及网卡各队列中断所在的CPU.
+// 只读取本进程允许运行的CPU(sched_getaffinity), sysfs不可读时退回为单节点、每个CPU一个物理核.
+class cpu_topology {
+public:
+    struct cpu_info {
+        int cpu;
+        int node;
+        int package;
+        int core;
+    };
+
+    cpu_topology() : node_count_(1) {}
+
+    // sysfs_root一般为"/sys", 测试时指向伪造的目录树; allowed为空时取本进程的sched_getaffinity.
+    // 从sysfs读到在线CPU列表时返回true
+    bool load(const std::string& sysfs_root = "/sys", const cpu_set_t* allowed = nullptr);
+
+    const std::vector<cpu_info>& cpus() const { return cpus_; }
+    int node_count() const { return node_count_; }
+    int node_of(int cpu) const;
+    // 绑核顺序: 按NUMA节点依次排列, 节点内先是每个物理核的第一个超线程, 再是其余超线程,
+    // 前n个线程尽量落在同一节点的不同物理核上
+    const std::vector<int>& placement() const { return placement_; }
+    // 网卡ifname各MSI中断的亲和CPU(优先取内核实际生效的effective_affinity_list), 按中断号排序并去重;
+    // 网卡的每个收发队列一般有一个中断, 其中也包括少量管理中断
+    std::vector<int> nic_irq_cpus(const std::string& ifname, const std::string& proc_root = "/proc") const;
+
+    // 解析"0-3,8,10-11"形式的CPU列表
+    static std::vector<int> parse_cpu_list(const std::string& list);
+    static bool pin_thread(pthread_t thread, int cpu);
+    // 创建线程, cpu不小于0时创建即绑核, 线程首次写入的栈和线程本地数据分配在该CPU的节点上
+    static int create_thread(pthread_t* thread, int cpu, void* (*fn)(void*), void* arg);
+    // 把[addr, addr+len)上的页放到nodes上: 一个节点时优先分配在该节点, 多个节点时交错分配;
+    // 已经分配的页迁移过去. addr需按页对齐; 内核不支持NUMA时返回false, 单节点主机上不必调用
+    static bool bind_memory(void* addr, size_t len, const std::vector<int>& nodes);
+
+private:
+    std::string sysfs_root_;
+    std::vector<cpu_info> cpus_;
+    std::vector<int> placement_;
+    int node_count_;
+};
+
+#endif // CPU_TOPOLOGY_HPP
@@ -0,0 +1,83 @@
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "locker.hpp"
+
+// 进程内共享的静态文件缓存: 按真实路径分片的LRU, 缓存文件映射、打开的描述符、stat结果和预先生成的响应头.
+// 命中时不再有任何文件系统调用; 文件变化由inotify通知失效, 总映射大小受内存预算限制.
+class file_cache {
+public:
+    struct entry {
+        std::string path;
+        struct stat st;
+        char* addr;             // 整个文件的只读映射
+        int fd;                 // 供sendfile使用的描述符
+        std::string header;     // 预先生成的状态行、Content-Type、校验器和Content-Length
+        std::string etag;
+        std::string last_modified;
+        int wd;                 // inotify watch描述符
+
+        entry() : addr(nullptr), fd(-1), wd(-1) {}
+        ~entry();
+    };
+    typedef std::shared_ptr<const entry> entry_ptr;
+
+    static file_cache* get_instance() {
+        static file_cache instance;
+        return &instance;
+    }
+
+    // budget为0时不启用缓存
+    bool init(size_t budget, int shard_num = 16);
+    bool enabled() const { return enabled_; }
+
+    // 查找或加载path对应的缓存项; 文件不存在、不可读、是目录或超出预算时返回空, 由调用者走普通路径
+    entry_ptr get(const char* path);
+    void invalidate(const std::string& path);
+
+    // 由inode、大小和纳秒级修改时间生成ETag, weak时加W/前缀
+    static int format_etag(const struct stat& st, bool weak, char* buf, size_t size);
+
+    // 禁止拷贝和赋值
+    file_cache(const file_cache&) = delete;
+    file_cache& operator=(const file_cache&) = delete;
+
+private:
+    struct shard {
+        locker lock;
+        std::list<entry_ptr> lru;   // 表头为最近使用
+        std::unordered_map<std::string, std::list<entry_ptr>::iterator> index;
+        size_t bytes;
+        shard() : bytes(0) {}
+    };
+
+    file_cache();
+    ~file_cache();
+
+    shard& shard_for(const std::string& path);
+    entry_ptr load(const std::string& path);
+    void evict(shard& s);               // 调用者持有分片锁
+    bool watching(int wd);              // wd尚未触发
+    void drop_watch(int wd);
+    static void* watch_thread(void* arg);
+    void watch_loop();
+
+private:
+    bool enabled_;
+    size_t shard_budget_;   // 每个分片的映射字节上限
+    std::vector<shard*> shards_;
+
+    int inotify_fd_;
+    locker watch_lock_;
+    std::unordered_map<int, std::string> watches_;  // wd -> 路径
+};
+
+#endif // FILE_CACHE_HPP
@@ -0,0 +1,51 @@
+#ifndef HTTP_CHUNKED_HPP
+#define HTTP_CHUNKED_HPP
+
+#include <stddef.h>
+
+// 分块传输编码(Transfer-Encoding: chunked): 请求体的增量解码和响应分块头的生成.
+// 解码器可以在任意字节处中断, 读到新数据后从断点继续, 不需要等整个请求体到齐.
+class http_chunked {
+public:
+    enum STATUS {
+        CHUNK_MORE,     // 输入已用完或输出已写满, 需要更多输入或更大的输出缓冲区
+        CHUNK_DONE,     // 读到最后一个分块和结尾的空行
+        CHUNK_BAD       // 格式错误
+    };
+
+    static const long MAX_CHUNK_SIZE = 1L << 30;    // 单个分块长度上限, 超出按格式错误处理
+    static const int HEAD_ROOM = 10;                // 分块头"长度(16进制)\r\n"的最大长度
+    static const int TAIL_ROOM = 2;                 // 分块数据后的"\r\n"
+    static const char LAST_CHUNK[];                 // "0\r\n\r\n"
+    static const int LAST_CHUNK_LEN = 5;
+
+    class decoder {
+    public:
+        decoder() { reset(); }
+        void reset();
+        // 解码[in, in+len), 分块数据追加到[out, out+out_room); *used为消耗的输入字节数, *produced为写出的字节数.
+        // 返回CHUNK_MORE时, *used < len表示输出已写满
+        STATUS decode(const char* in, long len, long* used, char* out, long out_room, long* produced);
+
+    private:
+        enum STATE {
+            SIZE,           // 分块长度的16进制数字
+            SIZE_EXT,       // 分块扩展, 忽略到行尾
+            SIZE_LF,
+            DATA,
+            DATA_CR,
+            DATA_LF,
+            TRAILER,        // 尾部字段所在行的行首
+            TRAILER_LINE,   // 尾部字段, 忽略到行尾
+            FINAL_LF
+        };
+        STATE state_;
+        long remaining_;    // SIZE状态下为已解析的长度, DATA状态下为本分块剩余字节数
+        bool has_digit_;
+    };
+
+    // 把分块头写到head末尾之前, 即[head - 返回值, head), 调用者在数据前预留HEAD_ROOM字节
+    static int prepend_chunk_head(char* head, long size);
+};
+
+#endif // HTTP_CHUNKED_HPP
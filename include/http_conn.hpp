@@ -1,21 +1,41 @@
 #ifndef HTTP_CONN_HPP
 #define HTTP_CONN_HPP
 
+#include <limits.h>
+#include <stdint.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <map>
+#include <string>
+#include <atomic>
+#include <functional>
 
 
 #include "locker.hpp"
 #include "sql_connection_pool.hpp"
 #include "log.hpp"
+#include "file_cache.hpp"
+#include "buffer_pool.hpp"
+#include "http_scan.hpp"
+#include "http_chunked.hpp"
 
 class http_conn {
 public:
     // 常量
     static const int FILE_NAME_LEN = 200;   // 文件名最大长度
-    static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区大小
-    static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区大小
+    static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区初始大小, 不够时按2倍增长
+    static const int MAX_READ_BUFFER_SIZE = 65536;  // 读缓冲区上限, 请求头和请求体之和不能超过
+    static const int WRITE_BUFFER_SIZE = 2048;  // 写缓冲区每块大小
+    static const int MAX_WRITE_SLABS = 8;       // 一批响应最多使用的写缓冲区块数
+    static const int IDLE_TIMEOUT_MS = 15000;   // 连接空闲超时, 包括keep-alive等待和慢速客户端
+    static const int MAX_PIPELINE = 8;          // 一次writev最多合并的流水线响应数
+    static const int PIPELINE_MARGIN = 256;     // 写缓冲区剩余不足时不再合并后续响应
+    static const int MAX_HEADERS = 32;          // 每个请求记录的请求头数, 超出的只解析不记录
+    static const int MAX_RANGES = 8;            // Range请求最多的范围数, 超出时忽略Range返回整个文件
+    static const long RANGE_WINDOW = 1 << 20;   // 开放式范围(bytes=N-)一次最多返回的字节数
+    static const int MAX_BODY_SIZE = 65536;     // 分块请求体解码后的上限, 与Content-Length请求体相同
+    static const int CHUNK_BUFFER_SIZE = 16384; // 分块响应每次向生成函数要数据的缓冲区大小
 
     // HTTP请求方法枚举
     enum METHOD
@@ -47,7 +67,10 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        RANGE_NOT_SATISFIABLE,
+        NOT_MODIFIED,
+        STREAM_REQUEST
     };
 
     enum LINE_STATUS
@@ -57,90 +80,238 @@ public:
         LINE_OPEN
     };
 
-    http_conn() {}
-    ~http_conn() {}
+    // 分块响应的数据来源: 每次向buf写入至多size字节, 返回写入的字节数, 0表示结束, 负数表示出错(截断响应并关闭连接).
+    // 在发送线程中同步调用, 响应头和第一块数据一起发出, 之后每发完一块再要下一块, 不缓存整个响应体
+    typedef std::function<int(char *buf, int size)> producer;
+    // 动态响应的处理函数: 在解析完请求后调用, 可以读取请求头和请求体, 返回空的producer时响应500
+    typedef std::function<producer(http_conn &conn)> handler;
 
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, std::string user, std::string passwd, std::string sqlname);
+    // 全部连接共享的配置和用户表, 由创建连接的一方持有, 连接只保存指针
+    struct config {
+        std::string doc_root;   // 网站根目录
+        int close_log;          // 是否关闭日志
+        int max_conn;           // 全部事件循环的连接总数上限, 超过时accept后直接回复503
+        locker lock;            // 保护users
+        std::map<std::string, std::string> users;   // 从数据库读取的用户信息
+        std::map<std::string, handler> handlers;    // URL -> 动态响应的处理函数, 只在启动前注册
+        config() : close_log(0), max_conn(INT_MAX) {}
+    };
+
+    http_conn() : sockfd_(-1), read_buf_(nullptr), read_size_(0), ctx_(nullptr), write_buf_(nullptr),
+                  write_slab_count_(0), send_fd_(-1), dispatched_(0), returned_(0), config_(nullptr) {}
+    ~http_conn() { release_ctx(); }
+
+    void init(int sockfd, const sockaddr_in &addr, config *cfg, int TRIGMode, int epollfd, int *loop_user_count = nullptr);
     void close_conn(bool real_close = true);
+    // 工作线程中需要关闭连接时调用: 关闭收发两个方向并重新注册事件, 由所属事件循环收到EPOLLRDHUP/EPOLLHUP后
+    // 照常关闭(移出时间轮并释放资源); 工作线程自己不释放任何资源, 事件循环可能正在处理同一个描述符
+    void request_close();
     void process();
     bool read_once();
     bool write();
+    // 供io_uring等不经过epoll的I/O后端使用
+    int prepare_response();
+    int append_read(const char *data, int len);
+    bool advance_write(int n);
+    bool finish_write();
+    struct iovec *write_iov() { return ctx_->iv_ + iv_idx_; }
+    int write_iov_count() const { return iv_count_ - iv_idx_; }
+    // 读缓冲区中还有未处理的流水线请求, 调用者应直接再处理一次而不是等待读事件
+    bool has_pending_input() const { return read_idx_ > req_start_; }
+    // 当前请求是POST(解析后cgi_为1), 登录和注册需要数据库连接; 读到请求行的前几个字节即可判断, 供调度时分车道
+    bool needs_db() const;
+    // 过载时回复预先生成的503(带Retry-After)后由调用者关闭连接, 不解析请求也不占用缓冲区
+    void shed() { send_busy(sockfd_); }
+    static void send_busy(int sockfd);
+    int sockfd() const { return sockfd_; }
+    // 单事件循环模式下连接在主线程和工作线程之间的交接: 主线程交给线程池后调用mark_dispatched,
+    // 工作线程不再访问连接(已重新注册事件或转交其他车道)后调用mark_returned. 两者不相等时连接在工作线程手中,
+    // 主线程不能关闭它; 计数在连接复用时不清零, 迟到的mark_returned不会影响下一个连接
+    void mark_dispatched() { ++dispatched_; }
+    void mark_returned() { returned_.fetch_add(1, std::memory_order_release); }
+    bool in_worker() const { return dispatched_ != returned_.load(std::memory_order_acquire); }
+    // 请求头的名字和值都指向读缓冲区(已就地以'\0'结尾), 当前请求处理完之前有效, 没有时返回nullptr
+    const char *get_header(http_scan::HEADER_ID id, size_t *len = nullptr) const;
+    const char *get_header(const char *name, size_t *len = nullptr) const;
+    int header_count() const { return ctx_ ? ctx_->header_count_ : 0; }
+    const char *header_name(int i) const { return read_buf_ + req_start_ + ctx_->headers_[i].name_off; }
+    const char *header_value(int i, size_t *len = nullptr) const;
+    // 请求体, Content-Length请求体指向读缓冲区, 分块请求体为解码后的数据, 当前请求处理完之前有效
+    const char *body(long *len) const;
     sockaddr_in *get_address()
     {
         return &address_;
     }
-    void initmysql_result(connection_pool *connPool);
-    int timer_flag;
-    int improv; 
+    static void initmysql_result(connection_pool *connPool, config *cfg);
+    // 注册内置的动态页面(用户列表/users.html), 在用户表读入之后、启动事件循环之前调用
+    static void register_handlers(config *cfg);
 
 private:
     void init();
+    void reset_request();
+    bool acquire_ctx();
+    void release_ctx();
+    void compact_read();
+    bool reserve_read(long len = 1);
+    void relocate_read(char *dst, long from);
+    void free_read_buffer();
+    bool next_write_slab();
+    void free_write_buffer();
     HTTP_CODE process_read();
     bool process_write(HTTP_CODE ret);
     HTTP_CODE parse_request_line(char *text);
     HTTP_CODE parse_headers(char *text);
     HTTP_CODE parse_content(char *text);
+    HTTP_CODE parse_chunked();
+    bool grow_body();
     HTTP_CODE do_request();
+    void set_real_file(const char *page);
+    HTTP_CODE check_preconditions();
+    bool etag_matches(const char *list) const;
+    HTTP_CODE parse_range();
+    char *map_window(int fd, off_t start, off_t len);
     char *get_line() { return read_buf_ + start_line_; };
     LINE_STATUS parse_line();
     void unmap();
-    bool add_response(const char *format, ...);
-    bool add_content(const char *content);
-    bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
+    void hold_file();
+    void push_iov(char *base, size_t len);
+    void flush_segment();
+    bool write_sendfile();
+    bool next_chunk();
+    bool add_raw(const char *data, int len);
+    template <size_t N>
+    bool add_raw(const char (&text)[N]) { return add_raw(text, N - 1); }
+    bool add_canned(int status);
+    bool add_content(const char *content, int len);
+    bool add_status_line(int status);
+    bool add_headers(long content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_length(long content_length);
+    bool add_content_range(off_t start, off_t end);
+    bool add_date();
     bool add_linger();
+    bool add_validators();
     bool add_blank_line();
+    bool add_ranges();
 
-public:
-    static int epollfd_;
-    static int user_count_;
-    MYSQL *mysql_;
-    int state_;  //读为0, 写为1
+    // 请求头表项, 偏移相对于当前请求的起始位置, 读缓冲区扩容或搬移后仍然有效
+    struct header_field {
+        int name_off;
+        int name_len;
+        int value_off;
+        int value_len;
+    };
+
+    // Range请求的一个范围, addr为该范围在映射中的起始地址, 零拷贝路径下为空
+    struct byte_range {
+        off_t start;
+        off_t len;
+        char* addr;
+    };
+
+    // 已排队响应引用的文件, 整批发送完毕后释放
+    struct file_ref {
+        char* addr;
+        size_t len;
+        int fd;
+        file_cache::entry_ptr cached;
+    };
+
+    // 只在处理请求和发送响应期间需要的大块状态, 从块池取得, 连接空闲时归还,
+    // 空闲的长连接只占http_conn本身的几个缓存行
+    struct request_ctx {
+        header_field headers_[MAX_HEADERS];
+        int header_count_;
+        signed char header_index_[http_scan::HDR_COUNT];   // 已知请求头编号 -> headers_下标, -1表示没有
 
+        char real_file_[FILE_NAME_LEN];  // 客户请求的资源完整路径, 以网站根目录开头
+        int real_file_len_;
+        int doc_root_len_;            // 网站根目录在real_file_中的长度, 取得时拷贝一次
+        struct stat file_stat_;       // 目标文件的状态（是否存在、是否可读等）
+        char* file_address_;          // 文件映射后在内存中的起始地址
+        int file_fd_;                 // 零拷贝路径打开的文件, -1表示未打开
+        off_t file_offset_;           // 零拷贝路径已发送到的文件偏移
+        file_cache::entry_ptr cached_;    // 命中的共享缓存项, 映射和描述符归缓存所有
+        byte_range ranges_[MAX_RANGES];
+        int range_count_;   // 0表示返回整个文件
+        char etag_[48];             // 目标文件的ETag
+        char last_modified_[32];    // 目标文件的Last-Modified
 
+        const char* body_;          // 请求体
+        long body_len_;
+        char* body_buf_;            // 分块请求体解码后的数据, 从块池取得, 不够时换一块更大的
+        long body_size_;
+        long body_start_;           // 请求体在读缓冲区中相对请求起始的位置, 已解码的分块从这里被移除
+        http_chunked::decoder chunk_decoder_;
+        producer producer_;         // 正在发送的分块响应的数据来源, 发完最后一块后清空
+        char* chunk_buf_;           // 分块响应的当前一块, 前后留出分块头和CRLF的位置
+
+        file_ref files_[MAX_PIPELINE + MAX_RANGES];     // 多范围响应的每个范围各占一项
+        int file_count_;
+        char* write_slabs_[MAX_WRITE_SLABS];    // 本批响应使用的全部写缓冲区块
+        // writev结构体, 普通响应至多占响应头和文件两块, 多范围响应每个范围两块, 换写缓冲区块时多一块
+        struct iovec iv_[2 * MAX_PIPELINE + 2 * MAX_RANGES + MAX_WRITE_SLABS + 2];
+
+        request_ctx() : header_count_(0), file_address_(nullptr), file_fd_(-1), range_count_(0), body_(nullptr), body_len_(0),
+                        body_buf_(nullptr), body_size_(0), body_start_(0), chunk_buf_(nullptr), file_count_(0) {}
+    };
+
+public:
+    static std::atomic<int> user_count_;    // 全部事件循环的连接总数
+    static bool zero_copy_;     // 静态文件走sendfile零拷贝路径, 仅epoll后端使用
+
+    // 热数据: 每次读写和解析都会访问, 从缓存行边界开始连续存放
+    alignas(64) std::atomic<int> timer_flag;    // 工作线程处理失败, 需要主线程关闭连接
+    std::atomic<int> improv;        // 工作线程已处理完该连接的读/写事件
+    int state_;  //读为0, 写为1
+    uint64_t enqueue_ms_;   // 进入线程池队列的时间, 开启排队期限时才记录
 private:
     int sockfd_; // 该http连接的socket
-    sockaddr_in address_;    // 客户端地址
-    char read_buf_[READ_BUFFER_SIZE];   // 读缓存区
+    int epollfd_;   // 该连接注册的epoll内核事件表
+    int TRIGMode_;     // 触发模式（ET还是LT）
+    CHECK_STATE check_state_;   // 主状态机当前状态
+    METHOD method_; // 请求方法
+    char* read_buf_;    // 读缓存区, 从块池按需分配, 连接空闲时归还
+    long read_size_;    // 读缓存区大小
     long read_idx_; // 已读入的数据的最后一个字节的下一个位置
+    long req_start_;    // 当前请求在读缓冲区中的起始位置, 之前的请求已处理完
     long checked_idx_;  // 正在解析的字符位置
     int start_line_;    // 当前行在缓冲区的起始位置
-    char write_buf_[WRITE_BUFFER_SIZE]; // 写缓冲区
-    int write_idx_; // 
-    CHECK_STATE check_state_;   // 主状态机当前状态
-    METHOD method_; // 请求方法
-
-    char real_file_[FILE_NAME_LEN];  // 客户请求的资源完整路径
+    long line_len_;     // 当前行的长度, 不含行结束符
+    request_ctx* ctx_;  // 当前请求的大块状态, 空闲时为空
+    char* write_buf_;   // 当前写缓冲区块, 写满后换下一块, 已写入的部分作为iovec发送
+    int write_idx_; // 当前块中已写入的位置
+    int seg_start_; // 当前块中尚未放入iovec的数据的起始位置
+    int write_slab_count_;
+    int iv_count_;                // 被写内存块数量
+    int iv_idx_;                  // 第一个未写完的内存块
+    int bytes_to_send;  // 剩余待发送字节数
+    int bytes_have_send;// 已发送字节数
+    int send_fd_;                 // 本批最后一个响应用sendfile发送的文件, -1表示没有
     char* url_;   // 请求目标文件的URL
     char* version_;   // HTTP协议版本
-    char* host_;  // 主机名
     long content_length_;    // HTTP请求体长度
-    bool linger_;   // 是否保持连接
-
-    char* file_address_;          // 文件映射后在内存中的起始地址
-    struct stat file_stat_;       // 目标文件的状态（是否存在、是否可读等）
-    struct iovec iv_[2];          // writev结构体
-    int iv_count_;                // 被写内存块数量
-
     int cgi_;            // 是否启用CGI（处理POST请求）
-    std::string string_;     // 存储POST请求体数据（如用户名、密码）
-    int bytes_to_send;  // 剩余待发送字节数
-    int bytes_have_send;// 已发送字节数
-
-    std::string doc_root_;     // 网站根目录
-
-    locker lock_;
-    std::map<std::string, std::string> users_; // 从数据库读取的用户信息
-
-    int TRIGMode_;     // 触发模式（ET还是LT）
-    int close_log_;    // 是否关闭日志
-
-    std::string sql_user_;     // 数据库用户名
-    std::string sql_passwd_;   // 数据库密码
-    std::string sql_name_;     // 数据库名
+    bool chunked_;  // 请求体使用分块传输编码
+    bool linger_;   // 是否保持连接
+    bool keep_alive_;   // 本批最后一个响应之后是否保持连接
+    int dispatched_;    // 交给工作线程的次数, 只由主线程修改
+    std::atomic<int> returned_;     // 工作线程交还的次数
 
+    // 冷数据: 只在建立连接、关闭连接和处理CGI时访问
+public:
+    alignas(64) MYSQL *mysql_;
+private:
+    config* config_;    // 共享配置, 不再每个连接拷贝根目录、数据库账号和用户表
+    int close_log_;    // 是否关闭日志, 供LOG宏使用
+    int* loop_user_count_;  // 所属事件循环的连接计数, 单事件循环时为空
+    sockaddr_in address_;    // 客户端地址
 };
 
+// epoll辅助函数, 供主线程与http_conn共用
+int setnonblocking(int fd);
+void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
+void removefd(int epollfd, int fd);
+void modfd(int epollfd, int fd, int ev, int TRIGMode);
+
 #endif
\ No newline at end of file
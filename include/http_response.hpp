@@ -0,0 +1,42 @@
+#ifndef HTTP_RESPONSE_HPP
+#define HTTP_RESPONSE_HPP
+
+#include <stddef.h>
+#include <time.h>
+
+// 响应头的预先生成部分: 状态行、完整的错误响应、每秒更新的Date头、整数转十进制和按扩展名查找的MIME类型.
+// 生成响应头时只需把这些片段依次memcpy到写缓冲区, 不再经过vsnprintf.
+class http_response {
+public:
+    struct text {
+        const char* data;
+        int len;
+    };
+
+    // 固定内容的响应: 状态行+Content-Type+Content-Length, 以及响应体, 调用者在两者之间补上Date和Connection
+    struct canned {
+        text head;
+        text body;
+    };
+
+    // "HTTP/1.1 200 OK\r\n", 未知状态码返回500的状态行
+    static const text& status_line(int status);
+    // 400/403/404/416/500以及空文件的响应, 未知状态码返回500
+    static const canned& canned_response(int status);
+    // 当前秒的"Date:...\r\n", 每个线程每秒格式化一次
+    static const text& date_header();
+
+    // 十进制写入buf, 返回长度, buf至少20字节
+    static int itoa(unsigned long long v, char* buf);
+    // "bytes a-b/size", buf至少64字节
+    static int format_content_range(char* buf, long long start, long long end, long long size);
+
+    // 按路径的扩展名(不区分大小写)查找Content-Type, 未知类型返回application/octet-stream
+    static const text& mime_type(const char* path, size_t len);
+
+    // HTTP日期(IMF-fixdate)的格式化和解析, 解析失败返回-1
+    static int format_http_date(time_t t, char* buf, size_t size);
+    static time_t parse_http_date(const char* text);
+};
+
+#endif // HTTP_RESPONSE_HPP
@@ -0,0 +1,61 @@
+#ifndef HTTP_SCAN_HPP
+#define HTTP_SCAN_HPP
+
+#include <stddef.h>
+
+// HTTP请求报文的向量化扫描: 每次比较16(SSE4.2)或32(AVX2)字节查找行结束符和':',
+// 启动时按CPU支持的指令集选择实现, 不支持时退回逐字节扫描. 已知请求头名用完美哈希识别.
+class http_scan {
+public:
+    // 已知请求头编号, 未知请求头为HDR_UNKNOWN
+    enum HEADER_ID
+    {
+        HDR_UNKNOWN = 0,
+        HDR_CONNECTION,
+        HDR_CONTENT_LENGTH,
+        HDR_CONTENT_TYPE,
+        HDR_HOST,
+        HDR_IF_NONE_MATCH,
+        HDR_IF_MODIFIED_SINCE,
+        HDR_RANGE,
+        HDR_IF_RANGE,
+        HDR_ACCEPT_ENCODING,
+        HDR_COOKIE,
+        HDR_TRANSFER_ENCODING,
+        HDR_USER_AGENT,
+        HDR_ACCEPT,
+        HDR_ACCEPT_LANGUAGE,
+        HDR_REFERER,
+        HDR_EXPECT,
+        HDR_UPGRADE,
+        HDR_AUTHORIZATION,
+        HDR_KEEP_ALIVE,
+        HDR_CACHE_CONTROL,
+        HDR_COUNT
+    };
+
+    // [p, p+len)中第一个'\r'或'\n'的偏移, 没有时返回len
+    static size_t find_eol(const char* p, size_t len) { return find_eol_(p, len); }
+    // [p, p+len)中第一个':'的偏移, 没有时返回len
+    static size_t find_colon(const char* p, size_t len) { return find_colon_(p, len); }
+
+    // 按名字(不区分大小写)查找请求头编号
+    static HEADER_ID lookup_header(const char* name, size_t len);
+    static const char* header_name(HEADER_ID id);
+
+    // 解析Content-Length的值[p, p+len): 只允许十进制数字且不超过max, 否则返回-1
+    static long parse_length(const char* p, size_t len, long max);
+
+    // 当前使用的实现: "avx2", "sse4.2"或"scalar"
+    static const char* impl() { return impl_; }
+    // 强制使用指定实现, CPU不支持时返回false, 供测试和基准对比使用
+    static bool select(const char* name);
+
+private:
+    typedef size_t (*scan_fn)(const char*, size_t);
+    static scan_fn find_eol_;
+    static scan_fn find_colon_;
+    static const char* impl_;
+};
+
+#endif // HTTP_SCAN_HPP
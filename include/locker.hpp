@@ -2,8 +2,15 @@
 #define LOCKER_HPP
 
 #include <exception>
+#include <atomic>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 class sem {
 public:
@@ -94,4 +101,79 @@ private:
     pthread_cond_t cond_;
 };
 
+// 自旋等待时让出流水线, 降低功耗并让超线程的另一半执行
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// 无锁队列的休眠/唤醒: 消费者取不到任务时先prepare_wait登记, 再检查一次队列, 仍为空才wait在futex上;
+// 生产者入队后notify, 没有休眠者时只是一次原子读, 不进入内核
+class parker {
+public:
+    parker() : seq_(0), waiters_(0) {}
+
+    // 返回当前序号, 之后必须调用wait或cancel_wait之一
+    uint32_t prepare_wait() {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        return seq_.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait() {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // 序号仍为key时休眠, 被唤醒、序号已变或被信号打断时返回; timeout_ms不小于0时最多等待这么久, 超时返回false
+    bool wait(uint32_t key, int timeout_ms = -1) {
+        struct timespec ts;
+        struct timespec* timeout = nullptr;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            timeout = &ts;
+        }
+        long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT_PRIVATE, key, timeout,
+                           nullptr, 0);
+        bool timed_out = ret == -1 && errno == ETIMEDOUT;
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return !timed_out;
+    }
+
+    // 有休眠者时唤醒一个并返回true
+    bool notify_one() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0) {
+            seq_.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+            return true;
+        }
+        return false;
+    }
+
+    // 有休眠者时一次系统调用唤醒至多n个并返回true, 批量投递后使用
+    bool notify_n(int n) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int waiters = waiters_.load(std::memory_order_relaxed);
+        if (waiters > 0) {
+            seq_.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, n < waiters ? n : waiters,
+                    nullptr, nullptr, 0);
+            return true;
+        }
+        return false;
+    }
+
+    void notify_all() {
+        seq_.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+    }
+
+private:
+    std::atomic<uint32_t> seq_;     // futex字, 每次唤醒加一
+    std::atomic<int> waiters_;      // 已登记或正在休眠的消费者数
+};
+
 #endif // LOCKER_HPP
\ No newline at end of file
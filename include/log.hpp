@@ -5,45 +5,95 @@
 #include <string>
 #include <iostream>
 #include <stdarg.h>
+#include <stdint.h>
 #include <pthread.h>
-#include <memory>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <atomic>
 #include <vector>
-#include "block_queue.hpp"
+#include "locker.hpp"
 
-class Log {
+// 每个写日志线程独占的单生产者单消费者字节环形缓冲区: 本线程直接把日志行格式化进去,
+// 后台刷盘线程取走已提交的部分写入文件. 读写位置只增不减, 下标取低位
+struct log_ring {
+    static const size_t CACHE_LINE = 64;
+
+    explicit log_ring(size_t capacity)
+        : data_(new char[capacity]), capacity_(capacity), head_(0), flushed_lines_(0), flushed_dropped_(0),
+          tail_(0), lines_(0), dropped_(0), orphan_(false) {}
+    ~log_ring() { delete[] data_; }
 
+    char* data_;
+    size_t capacity_;                   // 2的幂
+    // 用填充而不是alignas隔开, C++11的new不保证超过16字节的对齐
+    char pad0_[CACHE_LINE];
+    std::atomic<uint64_t> head_;        // 刷盘线程已写出的位置
+    uint64_t flushed_lines_;            // 仅由刷盘线程访问
+    uint64_t flushed_dropped_;
+    char pad1_[CACHE_LINE];
+    std::atomic<uint64_t> tail_;        // 本线程已提交的位置
+    std::atomic<uint64_t> lines_;       // 本线程提交的行数
+    std::atomic<uint64_t> dropped_;     // 缓冲区满丢弃的行数
+    std::atomic<bool> orphan_;          // 所属线程已退出, 写空后由刷盘线程释放
+};
+
+class Log {
+public:
+    static const size_t RING_SIZE = 64 * 1024;  // 异步模式下每个线程的环形缓冲区大小
+    static const int FLUSH_INTERVAL_MS = 100;   // 刷盘线程没有被唤醒时的刷盘周期
 
 private:
     std::string dir_name_; // 路径名
     std::string log_name_; // 日志文件名
     int split_lines_; // 每个日志文件的最大行数
-    int log_buf_size_; // 日志缓冲区大小
+    int log_buf_size_; // 每行日志的最大长度(含换行符)
     long long count_; // 日志行数计数
+    long long file_index_; // 当天按行数切分出的文件序号
     int today_; // 因为按天分类，记录今天的日期
-    // std::shared_ptr<FILE> fp_; // 打开log的文件指针
-    FILE* fp_; // 打开log的文件指针
-    std::vector<char> buf_; // 日志缓冲区
-    std::shared_ptr<block_queue<std::string>> log_queue_; // 阻塞队列
-    bool is_async_; // 是否同步标志位
-    locker mutex_; // 互斥锁
+    int fd_; // 日志文件, O_APPEND打开, 直接write(2)不经过stdio缓冲
+    bool is_async_; // 是否异步写
+    locker mutex_; // 同步模式下保护写文件和切分, 异步模式下保护rings_
     int close_log_; // 是否关闭日志
 
+    // 异步模式: 各线程写入自己的环形缓冲区, 不加锁也不做文件I/O, 缓冲区满时丢弃并计数;
+    // 刷盘线程定期或在某个缓冲区过半时被唤醒, 把所有缓冲区已提交的部分用一次writev写出
+    std::vector<log_ring*> rings_;  // 所有线程的缓冲区, 注册和释放时加mutex_
+    locker flush_mutex_;            // 同一时刻只有一个线程消费缓冲区(刷盘线程或flush)
+    parker wakeup_;                 // 刷盘线程在此休眠
+    pthread_t flusher_;
+    bool flusher_running_;
+    std::atomic<bool> stop_;
+    std::vector<log_ring*> snapshot_;   // 以下仅由持有flush_mutex_的线程使用, 避免每轮分配
+    std::vector<uint64_t> ends_;
+    std::vector<struct iovec> iov_;
+
 private:
     Log();
     virtual ~Log();
-    void async_write_log(); // 异步写日志函数
+    void async_write_log(); // 刷盘线程主循环
+    log_ring* local_ring();                 // 本线程的缓冲区, 首次调用时注册
+    int format_header(char* dst, int level, const struct timeval& now);
+    // 格式化一行日志到dst(至少log_buf_size_字节), 超长内容被截断, 返回含换行符的长度
+    int format_line(char* dst, int level, const struct timeval& now, const char* format, va_list valst);
+    void flush_rings();                     // 写出所有缓冲区中已提交的日志, 调用者持有flush_mutex_
+    void rotate(const struct tm& tm, long long lines);     // 按日期和行数切分日志文件, lines为即将写入的行数
+    bool open_file(const struct tm& tm, long long index);   // index大于0时文件名加上.index后缀
+    void stop_flusher();
 
 public:
     static Log* get_instance() {
         static Log instance;
         return &instance;
     }
-    static void flush_log_thread() {    // 异步写日志线程函数
-        Log::get_instance()->async_write_log();
+    static void* flush_log_thread(void* arg) {    // 异步写日志线程函数
+        static_cast<Log*>(arg)->async_write_log();
+        return nullptr;
     }
 
+    // max_queue_size大于0时异步写并启动刷盘线程, 否则同步写. 可以重复调用, 重新打开日志文件
     bool init(const char* file_name, int close_log, int split_lines = 5000000, int log_buf_size = 8192,  int max_queue_size = 0);
     void write_log(int level, const char* format, ...);
+    // 异步模式下立即写出各线程缓冲区中已提交的日志; 同步模式下每行都已直接写入文件
     void flush();
 
     // 禁止拷贝和赋值
@@ -56,13 +106,13 @@ public:
 
 };
 
-#define XXX(level, format, ...) if (close_log_==0) { Log::get_instance()->write_log(level, format, ##__VA_ARGS__); Log::get_instance()->flush(); }
+#define XXX(level, format, ...) if (close_log_==0) { Log::get_instance()->write_log(level, format, ##__VA_ARGS__); }
 
 #define LOG_DEBUG(format, ...) XXX(0, format, ##__VA_ARGS__)
-#define LOG_INFO(format, ...)  XXX(1, format, ##__VA_ARGS__)        
+#define LOG_INFO(format, ...)  XXX(1, format, ##__VA_ARGS__)
 #define LOG_WARN(format, ...)  XXX(2, format, ##__VA_ARGS__)
 #define LOG_ERROR(format, ...) XXX(3, format, ##__VA_ARGS__)
 #define LOG_FATAL(format, ...) XXX(4, format, ##__VA_ARGS__)
 
 
-#endif // LOG_H
\ No newline at end of file
+#endif // LOG_H
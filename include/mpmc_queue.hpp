@@ -0,0 +1,149 @@
+#ifndef MPMC_QUEUE_HPP
+#define MPMC_QUEUE_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+// 有界多生产者多消费者无锁环形队列(Vyukov): 每个槽带一个序号, 生产者和消费者各自用CAS抢占位置,
+// 抢到后只访问自己的槽, 不需要锁也不分配内存. 入队和出队位置各占一个缓存行, 互不干扰.
+// 容量取不小于capacity的2的幂.
+template <typename T>
+class mpmc_queue {
+public:
+    static const size_t CACHE_LINE = 64;
+
+    explicit mpmc_queue(size_t capacity) : cells_(round_up(capacity)), mask_(cells_.size() - 1) {
+        if (capacity == 0) {
+            throw std::exception();
+        }
+        for (size_t i = 0; i < cells_.size(); ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    // 队列满时返回false
+    bool try_push(const T& value) {
+        cell* c;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            long diff = (long)seq - (long)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = value;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列空时返回false
+    bool try_pop(T& value) {
+        cell* c;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            long diff = (long)seq - (long)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = c->data;
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 一次CAS取走队头连续就绪的至多max个元素, 返回取到的个数, 队列空时返回0
+    size_t try_pop_bulk(T* out, size_t max) {
+        if (max == 0) {
+            return 0;
+        }
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t n;
+        for (;;) {
+            // 数出从pos开始已写入的槽
+            n = 0;
+            while (n < max) {
+                size_t seq = cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire);
+                if (seq != pos + n + 1) {
+                    break;
+                }
+                ++n;
+            }
+            if (n == 0) {
+                size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+                if ((long)seq - (long)(pos + 1) < 0) {
+                    return 0;
+                }
+                pos = dequeue_pos_.load(std::memory_order_relaxed);    // 被其他消费者抢先
+                continue;
+            }
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            cell& c = cells_[(pos + i) & mask_];
+            out[i] = c.data;
+            c.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    // 近似的元素个数, 仅供统计
+    size_t size_approx() const {
+        size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    // 禁止拷贝和赋值
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+private:
+    struct cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    static size_t round_up(size_t n) {
+        size_t size = 2;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+private:
+    // 用填充而不是alignas隔开, C++11的new不保证超过16字节的对齐
+    char pad0_[CACHE_LINE];
+    std::vector<cell> cells_;
+    size_t mask_;
+    char pad1_[CACHE_LINE];
+    std::atomic<size_t> enqueue_pos_;
+    char pad2_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos_;
+    char pad3_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif // MPMC_QUEUE_HPP
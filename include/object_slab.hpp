@@ -0,0 +1,50 @@
+#ifndef OBJECT_SLAB_HPP
+#define OBJECT_SLAB_HPP
+
+#include <stddef.h>
+#include <new>
+#include <exception>
+#include <sys/mman.h>
+
+// 以下标访问的定长对象数组, 一次性从匿名映射中切出, 按最大描述符数分配.
+// 映射按页对齐, 对象按T自身的对齐(如缓存行)排列; 构造时只写入对象本身,
+// 占用的内存随容量线性确定, 与连接数和请求量无关. 非线程安全, 创建和销毁由所有者负责.
+template <typename T>
+class object_slab {
+public:
+    explicit object_slab(size_t count) : count_(count), bytes_(count * sizeof(T)) {
+        void* addr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (addr == MAP_FAILED)
+            throw std::exception();
+        // 对象按下标顺序访问的机会很少, 关闭预读并允许合并成大页
+        madvise(addr, bytes_, MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+        madvise(addr, bytes_, MADV_HUGEPAGE);
+#endif
+        objects_ = static_cast<T*>(addr);
+        for (size_t i = 0; i < count_; ++i)
+            new (objects_ + i) T();
+    }
+
+    ~object_slab() {
+        for (size_t i = 0; i < count_; ++i)
+            objects_[i].~T();
+        munmap(objects_, bytes_);
+    }
+
+    T& operator[](size_t i) { return objects_[i]; }
+    T* data() { return objects_; }
+    size_t size() const { return count_; }
+    size_t bytes() const { return bytes_; }
+
+    // 禁止拷贝和赋值
+    object_slab(const object_slab&) = delete;
+    object_slab& operator=(const object_slab&) = delete;
+
+private:
+    T* objects_;
+    size_t count_;
+    size_t bytes_;
+};
+
+#endif // OBJECT_SLAB_HPP
@@ -8,9 +8,10 @@
 #include "log.hpp"
 
 class connection_pool {
-public:
-
 private:
+    connection_pool();
+    ~connection_pool();
+
     int max_conn_;   // 最大连接数
     int cur_conn_;   // 当前连接数
     int free_conn_;  // 空闲连接数
@@ -40,6 +41,7 @@ public:
 };
 
 
+//connPool为空时不取连接, *con保持为空
 class connectionRAII{
 
 public:
@@ -47,6 +49,7 @@ public:
 	~connectionRAII();
 	
 private:
+	MYSQL **sqlRAII;
 	MYSQL *conRAII;
 	connection_pool *poolRAII;
 };
@@ -0,0 +1,75 @@
+#ifndef SUB_REACTOR_HPP
+#define SUB_REACTOR_HPP
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <atomic>
+#include <string>
+
+#include "http_conn.hpp"
+#include "sql_connection_pool.hpp"
+#include "timer_wheel.hpp"
+
+// one loop per thread: 每个sub_reactor拥有独立的epoll、SO_REUSEPORT监听socket和连接计数,
+// 在本线程内完成accept、读写和请求处理, 不经过线程池
+class sub_reactor {
+public:
+    static const int MAX_EVENT_NUMBER = 1024;  // 每轮epoll_wait最多处理的事件数
+
+    sub_reactor();
+    ~sub_reactor();
+
+    void init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int listen_trig_mode,
+              int conn_trig_mode, int opt_linger, connection_pool* conn_pool);
+    // 在start之前调用: 线程绑定到cpu; steer_incoming时监听socket设置SO_INCOMING_CPU,
+    // 与网卡队列中断配对, 该CPU上收到的新连接优先交给本事件循环
+    void set_cpu(int cpu, bool steer_incoming) { cpu_ = cpu; steer_incoming_ = steer_incoming; }
+    bool start();   // 创建监听socket/epoll并启动线程
+    void stop();    // 通知事件循环退出
+    void join();    // 等待线程退出
+
+    int id() const { return id_; }
+    int user_count() const { return user_count_; }
+    long long request_count() const { return request_count_; }
+
+    // 禁止拷贝和赋值
+    sub_reactor(const sub_reactor&) = delete;
+    sub_reactor& operator=(const sub_reactor&) = delete;
+
+private:
+    static void* worker(void* arg);
+    void run();
+    void deal_client_data();
+    void deal_with_read(int sockfd);
+    void deal_with_write(int sockfd);
+    void close_conn(int sockfd);
+
+private:
+    int id_;                // 事件循环编号
+    int port_;
+    int listenfd_;          // 本线程独占的SO_REUSEPORT监听socket
+    int epollfd_;           // 本线程独占的epoll内核事件表
+    int wakeup_fd_;         // eventfd, 用于通知事件循环退出
+    pthread_t thread_;
+    int cpu_;               // 绑定的CPU, -1表示不绑核
+    bool steer_incoming_;
+    std::atomic<bool> stop_;
+
+    http_conn* users_;      // 以connfd为下标, 本线程只访问自己accept的fd
+    int max_fd_;
+    http_conn::config* conn_config_;    // 全部连接共享的配置
+    int listen_trig_mode_;
+    int conn_trig_mode_;
+    int opt_linger_;
+    int close_log_;
+    connection_pool* conn_pool_;
+
+    timer_wheel* timers_;       // 本事件循环独占的空闲超时时间轮
+    uint64_t now_ms_;           // 本轮epoll_wait返回时的时间
+
+    int user_count_;            // 本事件循环的连接数, 仅由本线程修改
+    long long request_count_;   // 本事件循环处理的读事件数
+    epoll_event events_[MAX_EVENT_NUMBER];
+};
+
+#endif // SUB_REACTOR_HPP
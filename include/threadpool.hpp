@@ -2,42 +2,632 @@
 #define THEAD_POOL_HPP
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 #include <exception>
-#include <list>
+#include <memory>
 #include <vector>
 #include "locker.hpp"
+#include "mpmc_queue.hpp"
+#include "ws_deque.hpp"
 #include "sql_connection_pool.hpp"
 
 template <typename T>
 class threadpool {
 public:
-    threadpool(int actor_model, connection_pool* connPool, int thread_num=8, int max_request=10000);
+    static const int SPIN_COUNT = 100;  // 取不到任务时休眠前的自旋次数, 单核机器上不自旋
+    static const int MAX_SUBMITTERS = 16;       // 工作窃取模式下最多为多少个投递线程各建一个双端队列
+    static const int STEAL_BATCH = 8;           // 一次窃取最多取走的任务数
+    static const int TAKE_BATCH = 8;            // 共享队列模式下一次最多取走的任务数
+    static const size_t LOCAL_DEQUE_SIZE = 64;  // 工作线程自己的双端队列容量, 只存放窃取来的多余任务
+    static const int IDLE_MS = 30000;           // 弹性模式下超出min_thread的线程空闲这么久后退出
+
+    // thread_num为线程数上限, min_thread在1到thread_num-1之间时线程数随积压在两者之间伸缩, 否则固定为thread_num.
+    // work_stealing为true时每个工作线程和每个投递线程各有一个Chase-Lev双端队列, 空闲线程从随机的对象窃取.
+    // cpus非空时第i个槽位的线程创建时即绑定到cpus[i % cpus.size()].
+    // connPool为空时处理请求不取数据库连接, 作为只处理静态请求的快车道, 需要数据库的请求转给set_db_lane指定的线程池
+    threadpool(int actor_model, connection_pool* connPool, int thread_num=8, int max_request=10000,
+               bool work_stealing=false, int min_thread=0, int idle_ms=IDLE_MS,
+               const std::vector<int>& cpus=std::vector<int>());
     ~threadpool();
     bool append(T* request, int state); // 添加任务到请求队列, state用于模型切换
     bool append_p(T* request);
+    // 批量投递: 只入队不唤醒, 一轮事件处理完后由同一投递线程调用flush, 按本轮入队的任务数一次唤醒工作线程
+    bool append_p_batched(T* request);
+    void flush();
+    // 停止接收任务, 等工作线程处理完已入队的任务后回收全部线程; 由投递任务的线程调用, 可重复调用
+    void shutdown();
+    int live_threads() const { return live_.load(std::memory_order_relaxed); }
+    // 排队期限: 任务在队列中等待超过deadline_ms时不再处理, 调用T::shed回复过载后关闭连接, 0表示不限.
+    // 按每个任务实际的排队时间而不是队列长度判断, 突发流量能排进队列, 持续积压时丢掉已经等不起的请求
+    void set_queue_deadline(int deadline_ms) { deadline_ms_ = deadline_ms; }
+    long long shed_count() const { return shed_count_.load(std::memory_order_relaxed); }
+    // 快车道在工作线程中才发现需要数据库的请求(reactor模式读完之后、流水线中的下一个请求)转给db_lane,
+    // db_lane为proactor模式、持有连接池的线程池, 线程数与连接数相同
+    void set_db_lane(threadpool* db_lane) { db_lane_ = db_lane; }
 private:
+    enum SLOT_STATE { SLOT_FREE, SLOT_RUNNING, SLOT_EXITED };
+
+    // 每个工作线程的状态, 按线程数上限预先分配, 线程退出后槽位留给下一个新建的线程
+    struct worker_slot {
+        worker_slot() : deque(LOCAL_DEQUE_SIZE), cpu(-1), parked(0), pool(nullptr), index(0), state(SLOT_FREE) {}
+        ws_deque<T*> deque;         // 以下三项只在工作窃取模式下使用
+        parker idle;                // 只有本线程在此休眠, 投递者可以指定唤醒谁
+        std::atomic<int> cpu;       // 最近一次休眠前所在的CPU
+        std::atomic<int> parked;    // 已登记休眠且还没有被唤醒
+        threadpool* pool;
+        int index;
+        pthread_t tid;
+        std::atomic<int> state;     // 线程退出前置为SLOT_EXITED, 由下一个使用槽位的人或shutdown回收
+    };
+
     static void* worker(void* arg); // 线程工作函数，处理请求
-    void run(); // 线程池运行函数
+    void run(int self); // 线程池运行函数
+    size_t take(T** batch); // 取一批任务, 队列空时先自旋再休眠; 返回0表示本线程应当退出
+    size_t pop_batch(T** batch);
+    void process_request(T* request);
+    void run_request(T* request);   // 处理已读入的请求, 按需要取数据库连接或转给数据库车道
+    bool post(T* request, bool defer);
+    bool enqueue(T* request);
+    void notify(int n);             // 入队n个任务后唤醒工作线程, 都在忙时看是否需要加线程
+    size_t backlog();               // 近似的积压任务数
+    // 弹性伸缩
+    void maybe_grow(size_t pending);    // 没有空闲线程且积压超过线程数时加一个线程
+    bool spawn();                       // 在空闲槽位上创建线程, 需持有threads_lock_
+    bool retire();                      // 空闲超时, 线程数大于下限时减一并返回true
+    // 工作窃取模式
+    ws_deque<T*>* submit_deque();   // 当前投递线程的双端队列, 第一次投递时创建
+    bool wake(int cpu);             // 唤醒一个休眠的工作线程, 优先上次运行在cpu上的; 没有休眠线程时返回false
+    T* take_stealing(int self, unsigned& seed);
+    bool steal_some(int self, unsigned& seed, T*& request);
+    bool steal_from(ws_deque<T*>* victim, worker_slot* me, T*& request);
+    bool has_work();
+    static uint64_t now_ms();
 
 private:
-    // 线程池中的线程数量
+    // 线程池中的线程数量上限和下限
     int thread_num_;
+    int min_thread_;
     // 请求队列中允许的最大请求数
     int max_requests_;
-    // 线程池数组
-    // pthread_t* threads_;
-    std::vector<pthread_t> threads_;
-    // 请求队列
-    std::list<T*> work_queue_;
-    // 保护请求队列的互斥锁
-    locker queue_locker_;
-    // 信号量，是否有任务需要处理
-    sem queue_sem_;
-    // 数据库连接池
+    // 空闲线程休眠的超时时间, 线程数固定时为-1
+    int idle_ms_;
+    std::atomic<int> live_;     // 已创建且没有因空闲退出的线程数
+    std::atomic<bool> stop_;
+    locker threads_lock_;       // 创建和回收线程
+    std::vector<int> cpus_;     // 工作线程绑定的CPU, 为空时不绑核
+    int unflushed_;             // 批量投递后还没有唤醒的任务数, 只由投递线程访问
+    int deadline_ms_;           // 排队期限, 0表示不限
+    std::atomic<long long> shed_count_;     // 因超过排队期限被丢弃的任务数
+    // 请求队列, 无锁有界环形队列, 容量取不小于max_requests_的2的幂; 工作窃取模式下只接收投递线程队列满时溢出的任务
+    mpmc_queue<T*> work_queue_;
+    // 空闲工作线程在此休眠
+    parker idle_;
+    int spin_count_;
+    // 工作线程槽位, 共thread_num_个
+    std::vector<std::unique_ptr<worker_slot>> workers_;
+    // 工作窃取模式
+    bool work_stealing_;
+    // 投递线程的双端队列, 按线程登记, 登记后不再移除; 下标小于submit_count_的项已初始化
+    std::unique_ptr<ws_deque<T*>> submit_deques_[MAX_SUBMITTERS];
+    pthread_t submit_ids_[MAX_SUBMITTERS];
+    std::atomic<int> submit_count_;
+    locker submit_lock_;
+    // 数据库连接池, 快车道为空
     connection_pool* conn_pool_;
+    threadpool* db_lane_;
     // 模型切换
     int actor_model_;
 
 };
 
+template <typename T>
+threadpool<T>::threadpool(int actor_model, connection_pool* connPool, int thread_num, int max_request,
+                          bool work_stealing, int min_thread, int idle_ms, const std::vector<int>& cpus)
+    : thread_num_(thread_num), min_thread_(min_thread > 0 && min_thread < thread_num ? min_thread : thread_num),
+      max_requests_(max_request), idle_ms_(min_thread_ < thread_num ? idle_ms : -1), live_(0), stop_(false),
+      cpus_(cpus), unflushed_(0), deadline_ms_(0), shed_count_(0), work_queue_(max_request > 0 ? max_request : 1),
+      spin_count_(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_COUNT : 0), work_stealing_(work_stealing), submit_count_(0),
+      conn_pool_(connPool), db_lane_(nullptr), actor_model_(actor_model)
+{
+    if (thread_num <= 0 || max_request <= 0) {
+        throw std::exception();
+    }
+    for (int i = 0; i < thread_num; ++i) {
+        workers_.emplace_back(new worker_slot());
+        workers_[i]->pool = this;
+        workers_[i]->index = i;
+    }
+
+    // 创建线程池, 先创建下限数量的线程
+    threads_lock_.lock();
+    bool ok = true;
+    for (int i = 0; i < min_thread_ && ok; ++i) {
+        ok = spawn();
+    }
+    threads_lock_.unlock();
+    if (!ok) {
+        shutdown();
+        throw std::exception();
+    }
+}
+
+
+template <typename T>
+threadpool<T>::~threadpool() {
+    shutdown();
+}
+
+template <typename T>
+void threadpool<T>::shutdown() {
+    if (stop_.exchange(true)) {
+        return;
+    }
+    // 唤醒全部休眠的线程, 它们取完剩余任务、看到队列为空后退出
+    idle_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->idle.notify_all();
+    }
+    threads_lock_.lock();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        worker_slot* w = workers_[i].get();
+        if (w->state.load(std::memory_order_acquire) != SLOT_FREE) {
+            pthread_join(w->tid, nullptr);
+            w->state.store(SLOT_FREE, std::memory_order_relaxed);
+        }
+    }
+    live_.store(0);
+    threads_lock_.unlock();
+}
+
+template <typename T>
+bool threadpool<T>::spawn() {
+    if (live_.load() >= thread_num_) {
+        return false;
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        worker_slot* w = workers_[i].get();
+        int state = w->state.load(std::memory_order_acquire);
+        if (state == SLOT_RUNNING) {
+            continue;
+        }
+        if (state == SLOT_EXITED) {
+            pthread_join(w->tid, nullptr);  // 线程已经或即将返回, 不会阻塞太久
+        }
+        // 创建时就绑核, 线程从一开始就在目标CPU上运行, 它首次写入的栈和线程本地缓存分配在该CPU的节点上
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (!cpus_.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus_[i % cpus_.size()], &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        live_.fetch_add(1);
+        w->state.store(SLOT_RUNNING, std::memory_order_relaxed);
+        int ret = pthread_create(&w->tid, &attr, worker, w);
+        pthread_attr_destroy(&attr);
+        if (ret != 0) {
+            w->state.store(SLOT_FREE, std::memory_order_relaxed);
+            live_.fetch_sub(1);
+            return false;
+        }
+        return true;
+    }
+    return false;   // 退出中的线程已减了计数但还没让出槽位
+}
+
+template <typename T>
+void threadpool<T>::maybe_grow(size_t pending) {
+    int live = live_.load(std::memory_order_relaxed);
+    if (live >= thread_num_ || pending <= (size_t)live) {
+        return;
+    }
+    threads_lock_.lock();
+    if (!stop_.load()) {
+        spawn();
+    }
+    threads_lock_.unlock();
+}
+
+template <typename T>
+bool threadpool<T>::retire() {
+    // 超时后新入队的任务由其他醒着或被唤醒的线程处理, 线程数不会低于下限, 下限至少为1
+    int live = live_.load();
+    while (live > min_thread_) {
+        if (live_.compare_exchange_weak(live, live - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+bool threadpool<T>::append(T* request, int state) {
+    request->state_ = state; // 设置请求状态, 入队之后对取到它的工作线程可见
+    return post(request, false);
+}
+
+template <typename T>
+bool threadpool<T>::append_p(T* request) {
+    return post(request, false);
+}
+
+template <typename T>
+bool threadpool<T>::append_p_batched(T* request) {
+    return post(request, true);
+}
+
+template <typename T>
+void threadpool<T>::flush() {
+    if (unflushed_ > 0) {
+        notify(unflushed_);
+        unflushed_ = 0;
+    }
+}
+
+template <typename T>
+bool threadpool<T>::post(T* request, bool defer) {
+    if (stop_.load(std::memory_order_relaxed)) {
+        return false; // 已关闭
+    }
+    if (deadline_ms_ > 0) {
+        request->enqueue_ms_ = now_ms();
+    }
+    if (!enqueue(request)) {
+        return false; // 请求队列已满
+    }
+    if (defer) {
+        ++unflushed_;
+    } else {
+        notify(1);
+    }
+    return true; // 成功添加请求
+}
+
+template <typename T>
+bool threadpool<T>::enqueue(T* request) {
+    if (!work_stealing_) {
+        return work_queue_.try_push(request);
+    }
+    // 先放进本投递线程的双端队列, 满时退回共享队列
+    ws_deque<T*>* deque = submit_deque();
+    return (deque && deque->push(request)) || work_queue_.try_push(request);
+}
+
+template <typename T>
+void threadpool<T>::notify(int n) {
+    if (!work_stealing_) {
+        // 一次系统调用唤醒至多n个休眠的工作线程
+        if (!idle_.notify_n(n)) {
+            maybe_grow(backlog());
+        }
+        return;
+    }
+    // 每个被唤醒的线程一次窃取最多STEAL_BATCH个, 还有剩余时由它顺带唤醒下一个
+    int cpu = sched_getcpu();
+    int wakes = (n + STEAL_BATCH - 1) / STEAL_BATCH;
+    bool woken = false;
+    for (int i = 0; i < wakes && wake(cpu); ++i) {
+        woken = true;
+    }
+    if (!woken) {
+        maybe_grow(backlog());
+    }
+}
+
+template <typename T>
+size_t threadpool<T>::backlog() {
+    size_t pending = work_queue_.size_approx();
+    int n = submit_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        pending += submit_deques_[i]->size_approx();
+    }
+    return pending;
+}
+
+template <typename T>
+ws_deque<T*>* threadpool<T>::submit_deque() {
+    pthread_t self = pthread_self();
+    int n = submit_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        if (pthread_equal(submit_ids_[i], self)) {
+            return submit_deques_[i].get();
+        }
+    }
+    // 投递线程过多时退回共享队列
+    if (n >= MAX_SUBMITTERS) {
+        return nullptr;
+    }
+    ws_deque<T*>* deque = nullptr;
+    submit_lock_.lock();
+    n = submit_count_.load(std::memory_order_relaxed);
+    if (n < MAX_SUBMITTERS) {
+        submit_ids_[n] = self;
+        submit_deques_[n].reset(new ws_deque<T*>(max_requests_));
+        deque = submit_deques_[n].get();
+        submit_count_.store(n + 1, std::memory_order_release);
+    }
+    submit_lock_.unlock();
+    return deque;
+}
+
+template <typename T>
+bool threadpool<T>::wake(int cpu) {
+    // 与休眠方的"登记后再检查一次队列"配对, 任务放入后才检查有没有休眠的线程
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (true) {
+        // 优先唤醒上次在投递线程所在CPU上运行的空闲线程, 连接状态还留在这个核的缓存里
+        worker_slot* target = nullptr;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            worker_slot* w = workers_[i].get();
+            if (w->parked.load(std::memory_order_relaxed)) {
+                target = w;
+                if (w->cpu.load(std::memory_order_relaxed) == cpu) {
+                    break;
+                }
+            }
+        }
+        if (!target) {
+            return false; // 都醒着, 会在自旋或休眠前的检查中看到新任务
+        }
+        // 抢到休眠标志的人负责唤醒, 同一个线程不会被连续投递的任务重复唤醒而其他线程仍在休眠
+        if (target->parked.exchange(0) == 1) {
+            target->idle.notify_one();
+            return true;
+        }
+    }
+}
+
+template <typename T>
+void* threadpool<T>::worker(void* arg) {
+    worker_slot* slot = static_cast<worker_slot*>(arg);
+    slot->pool->run(slot->index); // 调用线程池的运行函数
+    return arg;
+}
+
+template <typename T>
+size_t threadpool<T>::pop_batch(T** batch) {
+    // 积压按现有线程数平均分, 一次最多TAKE_BATCH个; 积压少时每个被唤醒的线程只取一个, 不让别的线程空等
+    int live = live_.load(std::memory_order_relaxed);
+    size_t share = work_queue_.size_approx() / (live > 0 ? live : 1) + 1;
+    return work_queue_.try_pop_bulk(batch, share < (size_t)TAKE_BATCH ? share : TAKE_BATCH);
+}
+
+template <typename T>
+size_t threadpool<T>::take(T** batch) {
+    size_t n;
+    while (true) {
+        for (int i = 0; i < spin_count_; ++i) {
+            if ((n = pop_batch(batch)) > 0) {
+                return n;
+            }
+            cpu_relax();
+        }
+        // 先登记再检查一次, 避免在检查和休眠之间入队的任务没有人唤醒
+        uint32_t key = idle_.prepare_wait();
+        if ((n = pop_batch(batch)) > 0) {
+            idle_.cancel_wait();
+            return n;
+        }
+        // 已关闭且队列已空
+        if (stop_.load()) {
+            idle_.cancel_wait();
+            return 0;
+        }
+        if (!idle_.wait(key, idle_ms_) && retire()) {
+            return 0;
+        }
+    }
+}
+
+template <typename T>
+bool threadpool<T>::has_work() {
+    int n = submit_count_.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        if (submit_deques_[i]->size_approx() > 0) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        if (workers_[i]->deque.size_approx() > 0) {
+            return true;
+        }
+    }
+    return work_queue_.size_approx() > 0;
+}
+
+template <typename T>
+bool threadpool<T>::steal_from(ws_deque<T*>* victim, worker_slot* me, T*& request) {
+    if (!victim->steal(request)) {
+        return false;
+    }
+    // 再取走剩余的一半(最多STEAL_BATCH-1个)放进自己的队列, 其他空闲线程可以再从这里窃取.
+    // 只有自己的队列为空时才会窃取, 容量足够
+    size_t more = victim->size_approx() / 2;
+    if (more > (size_t)STEAL_BATCH - 1) {
+        more = STEAL_BATCH - 1;
+    }
+    T* extra;
+    while (more-- > 0 && victim->steal(extra)) {
+        me->deque.push(extra);
+    }
+    // 还有剩余任务时再叫醒一个线程帮忙, 一次投递多个任务时逐个把休眠的线程带起来
+    if (me->deque.size_approx() > 0 || victim->size_approx() > 0) {
+        wake(-1);
+    }
+    return true;
+}
+
+template <typename T>
+bool threadpool<T>::steal_some(int self, unsigned& seed, T*& request) {
+    // 对象依次是各投递线程的队列、其他工作线程的队列和共享的溢出队列, 从随机位置开始轮一圈
+    int submitters = submit_count_.load(std::memory_order_acquire);
+    int victims = submitters + thread_num_ + 1;
+    seed = seed * 1103515245u + 12345u;
+    int start = (seed >> 16) % victims;
+    worker_slot* me = workers_[self].get();
+    for (int k = 0; k < victims; ++k) {
+        int v = (start + k) % victims;
+        if (v < submitters) {
+            if (steal_from(submit_deques_[v].get(), me, request)) {
+                return true;
+            }
+        } else if (v < submitters + thread_num_) {
+            if (v - submitters != self && steal_from(&workers_[v - submitters]->deque, me, request)) {
+                return true;
+            }
+        } else if (work_queue_.try_pop(request)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+T* threadpool<T>::take_stealing(int self, unsigned& seed) {
+    worker_slot* me = workers_[self].get();
+    T* request = nullptr;
+    while (true) {
+        if (me->deque.pop(request)) {
+            return request;
+        }
+        for (int i = 0; i <= spin_count_; ++i) {
+            if (steal_some(self, seed, request)) {
+                return request;
+            }
+            cpu_relax();
+        }
+        // 先登记再检查一次所有队列, 与wake中的先放任务再检查标志配对
+        me->cpu.store(sched_getcpu(), std::memory_order_relaxed);
+        uint32_t key = me->idle.prepare_wait();
+        me->parked.store(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (has_work()) {
+            me->parked.store(0, std::memory_order_relaxed);
+            me->idle.cancel_wait();
+            continue;
+        }
+        // 已关闭且所有队列已空
+        if (stop_.load()) {
+            me->parked.store(0, std::memory_order_relaxed);
+            me->idle.cancel_wait();
+            return nullptr;
+        }
+        bool woken = me->idle.wait(key, idle_ms_);
+        me->parked.store(0, std::memory_order_relaxed);
+        if (!woken && retire()) {
+            return nullptr;
+        }
+    }
+}
+
+template <typename T>
+void threadpool<T>::run(int self) {
+    unsigned seed = self * 2654435761u + 1;
+    T* batch[TAKE_BATCH];
+    while (true) {
+        // 获取下一批请求, 为空表示线程池已关闭且没有剩余任务, 或本线程空闲超时被回收;
+        // 工作窃取模式下窃取来的多余任务放在自己的双端队列里, 每次取一个
+        size_t n;
+        if (work_stealing_) {
+            batch[0] = take_stealing(self, seed);
+            n = batch[0] ? 1 : 0;
+        } else {
+            n = take(batch);
+        }
+
+        if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            process_request(batch[i]);
+        }
+    }
+    workers_[self]->state.store(SLOT_EXITED, std::memory_order_release);
+}
+
+template <typename T>
+uint64_t threadpool<T>::now_ms() {
+    // 粗粒度时钟不进入内核也不读TSC, 精度是一个时钟节拍, 对毫秒级的期限足够
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+template <typename T>
+void threadpool<T>::process_request(T* request) {
+    // 排队超过期限: 客户端多半已经放弃, 回复503把线程留给还来得及的请求.
+    // reactor模式的写任务是发了一半的响应, 不能插入503, 照常处理
+    if (deadline_ms_ > 0 && !(actor_model_ == 1 && request->state_ == 1) &&
+        now_ms() - request->enqueue_ms_ > (uint64_t)deadline_ms_) {
+        shed_count_.fetch_add(1, std::memory_order_relaxed);
+        request->shed();
+        if (actor_model_ == 1) {
+            request->mark_returned();
+            request->timer_flag = 1;    // 由等待的主线程关闭连接, 必须先于improv设置
+            request->improv = 1;
+        } else {
+            // 数据库车道和proactor模式下主线程没有在等待, 交给事件循环关闭
+            request->request_close();
+            request->mark_returned();
+        }
+        return;
+    }
+    if (actor_model_ == 1) { // 主从模型：表示
+        if (request->state_ == 0) {
+            if (request->read_once()) {
+                request->improv = 1; // 设置improv标志，表示读操作已完成
+                run_request(request); // 处理请求
+            } else {
+                request->mark_returned();
+                request->timer_flag = 1; // 设置定时器标志，表示读操作失败, 先于improv设置
+                request->improv = 1;
+            }
+        } else { // 写操作
+            if (request->write()) {
+                // 读缓冲区中还有流水线请求, 直接继续处理
+                if (request->has_pending_input()) {
+                    run_request(request);
+                } else {
+                    request->mark_returned();
+                }
+                request->improv = 1;
+            } else {
+                request->mark_returned();
+                request->timer_flag = 1; // 设置定时器标志，表示写操作失败, 先于improv设置
+                request->improv = 1;
+            }
+        }
+    } else { // 其他模型（如线程池模型）
+        run_request(request); // 直接处理请求
+    }
+}
+
+// 处理完或转交数据库车道后连接交还主线程(mark_returned), 之后不再访问它
+template <typename T>
+void threadpool<T>::run_request(T* request) {
+    // 快车道不在连接池上等待, 需要数据库的请求排到数据库车道, 慢查询只拖慢真正用到数据库的请求
+    if (!conn_pool_ && db_lane_ && request->needs_db()) {
+        if (!db_lane_->append_p(request)) {
+            // reactor模式下主线程可能已经不在等待, 不能用timer_flag, 交给事件循环关闭
+            request->shed();
+            request->request_close();
+            request->mark_returned();
+        }
+        return;
+    }
+    {
+        // 连接取到局部变量上, 归还时不写回request: process重新注册事件后连接可能已被主线程
+        // 交给另一个工作线程, 那里会设置自己的mysql_. process在重新注册事件前清空mysql_
+        MYSQL* mysql = NULL;
+        connectionRAII mysqlcon(&mysql, conn_pool_); // RAII管理数据库连接, 快车道不取
+        request->mysql_ = mysql;
+        request->process();
+    }
+    request->mark_returned();
+}
+
 #endif // THEAD_POOL_HPP
\ No newline at end of file
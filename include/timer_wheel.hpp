@@ -0,0 +1,76 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <stdint.h>
+#include <vector>
+
+// 分层时间轮: 4层, 每层64个槽, 以id(一般为connfd)为下标的侵入式双向链表节点.
+// 添加/删除O(1); 刷新只改写节点的到期时间, 到期槽被处理时再把未真正到期的节点重新挂入,
+// 因此每次读写刷新连接的空闲期限几乎没有开销. 非线程安全, 由所属事件循环独占使用.
+class timer_wheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;    // 每层槽数
+
+    explicit timer_wheel(int capacity, int tick_ms = 100);
+
+    void add(int id, uint64_t expire_ms);       // 添加定时器, 已存在则重新挂入
+    void adjust(int id, uint64_t expire_ms);    // 延后到期时间, 不移动节点
+    void remove(int id);
+    bool contains(int id) const { return id >= 0 && id < (int)nodes_.size() && nodes_[id].level >= 0; }
+    int size() const { return count_; }
+
+    // 距离下一次需要处理时间轮的毫秒数, 没有定时器时返回-1, 可直接作为epoll_wait的超时参数
+    int next_timeout(uint64_t now_ms) const;
+
+    // 推进时间轮到now_ms, 对每个到期的id调用on_expire(id), 回调中可以add/remove
+    template <typename F>
+    void tick(uint64_t now_ms, F on_expire) {
+        uint64_t now = now_ms / tick_ms_;
+        while (cur_ < now && count_ > 0) {
+            ++cur_;
+            cascade();
+            // 新增定时器至少挂在下一个tick, 所以逐个摘除当前槽直到为空是安全的
+            int slot = (int)(cur_ & (SLOTS - 1));
+            int id;
+            while ((id = heads_[0][slot]) != -1) {
+                unlink(id);
+                if (nodes_[id].expire > cur_) {
+                    link(id);   // 期间被刷新过, 重新挂入
+                } else {
+                    on_expire(id);
+                }
+            }
+        }
+        // 没有定时器时直接追上当前时间
+        if (count_ == 0 && cur_ < now) {
+            cur_ = now;
+        }
+    }
+
+    static uint64_t now_ms();   // 单调时钟, 毫秒
+
+private:
+    struct node {
+        uint64_t expire;    // 到期时刻, 单位tick
+        int prev;
+        int next;
+        int level;          // 所在层, -1表示未挂入
+        int slot;
+    };
+
+    void link(int id);
+    void unlink(int id);
+    void cascade();
+
+private:
+    int tick_ms_;
+    uint64_t cur_;          // 已处理到的tick
+    int count_;
+    std::vector<node> nodes_;
+    int heads_[LEVELS][SLOTS];
+    uint64_t bitmap_[LEVELS];   // 非空槽位图, 用于快速计算下一次超时
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,89 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <vector>
+
+// 不依赖liburing的最小io_uring封装: 只包含服务器用到的提交/完成队列操作和provided buffer ring
+class uring {
+public:
+    uring();
+    ~uring();
+
+    bool init(unsigned entries);
+    // 注册provided buffer ring, 内核收包时从中挑选缓冲区
+    bool setup_buf_ring(unsigned short bgid, unsigned count, unsigned size);
+    char* buf_addr(unsigned short bid) { return bufs_ + (size_t)bid * buf_size_; }
+    // 把用完的缓冲区交还给内核
+    void recycle_buf(unsigned short bid);
+
+    // 取一个空闲SQE, 队列满时先提交一次; 仍然满(内核返回EBUSY等)时放入积压队列,
+    // 下次submit_and_wait时按顺序提交, 不会返回空, 提交的操作不会丢失
+    io_uring_sqe* get_sqe();
+    void prep_accept_multishot(int fd, unsigned long long user_data);
+    void prep_recv_multishot(int fd, unsigned short bgid, unsigned long long user_data);
+    void prep_read(int fd, void* buf, unsigned len, unsigned long long user_data);
+    void prep_writev(int fd, const iovec* iov, int iov_count, unsigned long long user_data);
+    void prep_cancel(unsigned long long target, unsigned long long user_data);
+    void prep_timeout(__kernel_timespec* ts, unsigned long long user_data);
+
+    // 一次系统调用提交全部待提交SQE并等待至少wait_nr个完成事件; 有积压时先分批提交积压的SQE.
+    // 完成队列溢出时返回-1且errno为EBUSY, 调用者收割完成事件后再提交
+    int submit_and_wait(unsigned wait_nr);
+
+    // 遍历完成队列, 每个CQE调用一次handler, 最后统一推进head
+    template <typename F>
+    unsigned for_each_cqe(F handler) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned n = 0;
+        for (; head != tail; ++head, ++n) {
+            handler(&cqes_[head & *cq_mask_]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    // 禁止拷贝和赋值
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+private:
+    int enter(unsigned wait_nr);    // 发布已填充的SQE并调用io_uring_enter
+    bool drain_backlog();           // 把积压的SQE按顺序搬进提交队列, 全部搬完时返回true
+
+private:
+    int ring_fd_;
+
+    // 提交队列
+    void* sq_ptr_;
+    size_t sq_len_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    io_uring_sqe* sqes_;
+    size_t sqes_len_;
+    unsigned sqe_tail_;         // 本地已填充但未发布的SQE尾部
+    std::vector<io_uring_sqe> backlog_;     // 提交队列满时暂存的SQE, 先于之后的SQE提交
+
+    // 完成队列
+    void* cq_ptr_;
+    size_t cq_len_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    io_uring_cqe* cqes_;
+
+    // provided buffer ring
+    io_uring_buf_ring* buf_ring_;
+    size_t buf_ring_len_;
+    char* bufs_;
+    unsigned buf_count_;
+    unsigned buf_size_;
+    unsigned short buf_tail_;
+};
+
+#endif // URING_HPP
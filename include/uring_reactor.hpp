@@ -0,0 +1,105 @@
+#ifndef URING_REACTOR_HPP
+#define URING_REACTOR_HPP
+
+#include <pthread.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "uring.hpp"
+#include "http_conn.hpp"
+#include "sql_connection_pool.hpp"
+#include "timer_wheel.hpp"
+
+// io_uring I/O后端: 多路accept + 基于provided buffer ring的多路recv, 响应用writev提交,
+// 每轮事件循环只用一次io_uring_enter批量提交SQE并收割CQE
+class uring_reactor {
+public:
+    static const unsigned RING_ENTRIES = 4096;      // 提交队列深度
+    static const unsigned BUF_COUNT = 1024;         // provided buffer数量, 必须是2的幂
+    static const unsigned BUF_SIZE = 2048;          // 单个provided buffer大小
+    static const unsigned short BUF_GROUP = 0;      // provided buffer组号
+
+    uring_reactor();
+    ~uring_reactor();
+
+    void init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int opt_linger,
+              connection_pool* conn_pool);
+    // 在start之前调用: 线程绑定到cpu; steer_incoming时监听socket设置SO_INCOMING_CPU,
+    // 与网卡队列中断配对, 该CPU上收到的新连接优先交给本事件循环
+    void set_cpu(int cpu, bool steer_incoming) { cpu_ = cpu; steer_incoming_ = steer_incoming; }
+    bool start();   // 创建监听socket/io_uring并启动线程
+    void stop();    // 通知事件循环退出
+    void join();    // 等待线程退出
+
+    int id() const { return id_; }
+    int user_count() const { return user_count_; }
+    long long request_count() const { return request_count_; }
+
+    // 禁止拷贝和赋值
+    uring_reactor(const uring_reactor&) = delete;
+    uring_reactor& operator=(const uring_reactor&) = delete;
+
+private:
+    // user_data编码: 高8位操作类型, 中间32位连接代数, 低24位fd
+    enum OP { OP_ACCEPT = 1, OP_RECV, OP_WRITE, OP_WAKEUP, OP_CANCEL, OP_TIMER };
+
+    // 每个fd在本事件循环中的I/O状态
+    struct conn_state {
+        unsigned gen;           // 连接代数, fd复用后旧请求的完成事件据此丢弃
+        bool writing;           // 是否有writev在途
+        bool receiving;         // 是否有多路recv在途
+        bool closing;           // 已关闭, 等在途的recv/writev完成后再释放连接
+        bool throttled;         // pending到达上限, 已取消recv, 响应发完后再恢复
+        std::string pending;    // 发送响应期间到达的数据, 上限为读缓冲区上限
+        conn_state() : gen(0), writing(false), receiving(false), closing(false), throttled(false) {}
+    };
+
+    static unsigned long long pack(int op, unsigned gen, int fd) {
+        return ((unsigned long long)op << 56) | ((unsigned long long)gen << 24) | (unsigned)fd;
+    }
+
+    static void* worker(void* arg);
+    void run();
+    void handle_cqe(const io_uring_cqe* cqe);
+    void on_accept(int connfd);
+    void on_data(int fd, const char* data, int len);
+    void serve(int fd);
+    void on_write(int fd, int res);
+    void start_write(int fd);
+    void start_recv(int fd);
+    void hold(int fd, const char* data, int len);
+    void close_conn(int fd);
+    void release_conn(int fd);
+    void arm_timer();
+
+private:
+    int id_;
+    int port_;
+    int listenfd_;
+    int wakeup_fd_;
+    unsigned long long wakeup_val_;
+    pthread_t thread_;
+    int cpu_;               // 绑定的CPU, -1表示不绑核
+    bool steer_incoming_;
+    std::atomic<bool> stop_;
+    uring ring_;
+
+    http_conn* users_;
+    std::vector<conn_state> states_;
+    int max_fd_;
+    http_conn::config* conn_config_;    // 全部连接共享的配置
+    int opt_linger_;
+    int close_log_;
+    connection_pool* conn_pool_;
+
+    timer_wheel* timers_;       // 本事件循环独占的空闲超时时间轮
+    uint64_t now_ms_;           // 本轮收割CQE时的时间
+    bool timer_armed_;          // 是否有在途的超时SQE
+    __kernel_timespec timer_ts_;
+
+    int user_count_;            // 本事件循环的连接数, 仅由本线程修改
+    long long request_count_;   // 本事件循环处理的recv完成事件数
+};
+
+#endif // URING_REACTOR_HPP
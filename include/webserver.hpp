@@ -0,0 +1,118 @@
+#ifndef WEBSERVER_HPP
+#define WEBSERVER_HPP
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <string>
+#include <vector>
+
+#include "threadpool.hpp"
+#include "http_conn.hpp"
+#include "sub_reactor.hpp"
+#include "uring_reactor.hpp"
+#include "coro_reactor.hpp"
+#include "timer_wheel.hpp"
+#include "object_slab.hpp"
+#include "cpu_topology.hpp"
+
+const int MAX_FD = 65536;           // 最大文件描述符
+const int MAX_EVENT_NUMBER = 10000; // 最大事件数
+
+class WebServer {
+public:
+    WebServer();
+    ~WebServer();
+
+    void init(int port, std::string user, std::string passwd, std::string database_name,
+              int log_write, int opt_linger, int trig_mode, int sql_num,
+              int thread_num, int min_thread, int close_log, int actor_model, int reactor_num, int io_backend,
+              int zero_copy, int file_cache_mb, int work_stealing,
+              int cpu_affinity, std::string nic, int max_conn, int queue_deadline_ms);
+
+    void cpu_affinity();    // 按CPU拓扑决定各线程绑定的CPU, 绑定主线程, 把连接对象放到所在NUMA节点
+    void thread_pool();     // 创建快车道和数据库车道线程池, 多reactor模式下不需要
+    void sql_pool();        // 初始化数据库连接池
+    void log_write();       // 初始化日志
+    void trig_mode();       // 设置listenfd和connfd的触发模式
+    void event_listen();    // 创建监听socket和epoll内核事件表
+    void event_loop();      // 主线程事件循环
+
+    // 禁止拷贝和赋值
+    WebServer(const WebServer&) = delete;
+    WebServer& operator=(const WebServer&) = delete;
+
+private:
+    bool deal_client_data();                // 处理新到的客户连接
+    bool deal_with_signal(bool& stop_server);   // 处理信号
+    void deal_with_read(int sockfd);        // 处理客户连接上的读事件
+    void deal_with_write(int sockfd);       // 处理客户连接上的写事件
+    void wait_worker(int sockfd);           // reactor模式下等待工作线程处理完毕
+    void dispatch(int sockfd);              // proactor模式: 把读入的请求交给对应车道的线程池
+    void reject(int sockfd);                // 队列已满, 回复503后关闭连接
+    void close_conn(int sockfd);            // 关闭连接并删除其定时器
+    void refresh_timer(int sockfd);         // 连接上有读写事件, 延后空闲期限
+    void start_reactors();                  // 多reactor/io_uring模式: 启动各事件循环
+    void stop_reactors();                   // 多reactor模式: 停止并回收各事件循环
+
+    static void sig_handler(int sig);
+    static void add_sig(int sig, void (*handler)(int), bool restart = true);
+
+private:
+    // 基础
+    int port_;              // 监听端口
+    int log_write_;         // 日志写入方式
+    int close_log_;         // 是否关闭日志
+    int actor_model_;       // 并发模型
+
+    static int pipefd_[2];  // 信号通知管道
+    int epollfd_;           // epoll内核事件表
+    object_slab<http_conn> conn_slab_;  // 按最大描述符数一次分配的连接对象
+    http_conn* users_;      // 以connfd为下标的连接数组, 即conn_slab_
+    http_conn::config conn_config_;     // 全部连接共享的根目录、日志开关和用户表
+
+    // 数据库相关
+    connection_pool* conn_pool_;
+    std::string user_;          // 登录数据库用户名
+    std::string passwd_;        // 登录数据库密码
+    std::string database_name_; // 使用数据库名
+    int sql_num_;
+
+    // 线程池相关
+    threadpool<http_conn>* pool_;       // 快车道: 静态文件等不需要数据库的请求
+    threadpool<http_conn>* db_pool_;    // 数据库车道: POST请求, 线程数与连接池大小相同
+    int thread_num_;
+    int min_thread_;        // 线程数下限, 0表示固定
+    int work_stealing_;     // 每线程双端队列+工作窃取
+    int queue_deadline_ms_; // 请求在队列中的等待期限, 0表示不限
+
+    // 绑核和NUMA放置
+    int cpu_affinity_;
+    std::string nic_;
+    cpu_topology topology_;
+    std::vector<int> loop_cpus_;    // 各事件循环绑定的CPU, 单事件循环时只有主线程一项
+    std::vector<int> worker_cpus_;  // 工作线程绑定的CPU
+    bool steer_incoming_;           // 事件循环与网卡队列中断配对
+
+    // epoll_event相关
+    epoll_event events_[MAX_EVENT_NUMBER];
+
+    // 定时器相关
+    timer_wheel timers_;        // 以connfd为id的空闲超时时间轮
+    uint64_t now_ms_;           // 本轮epoll_wait返回时的时间, 同一轮事件共用
+
+    // 多reactor相关
+    int reactor_num_;           // 事件循环数量, 0表示单事件循环
+    sub_reactor* reactors_;
+    int io_backend_;            // I/O后端: 0 epoll, 1 io_uring, 2 协程
+    uring_reactor* uring_reactors_;
+    coro_reactor* coro_reactors_;
+
+    int listenfd_;          // 监听socket
+    int opt_linger_;        // 优雅关闭连接
+    int trig_mode_;         // 触发组合模式
+    int listen_trig_mode_;  // listenfd触发模式
+    int conn_trig_mode_;    // connfd触发模式
+};
+
+#endif // WEBSERVER_HPP
@@ -0,0 +1,103 @@
+#ifndef WS_DEQUE_HPP
+#define WS_DEQUE_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+// 有界Chase-Lev工作窃取双端队列(按Lê等人的C11内存模型版本): 只有所有者线程在底部push/pop,
+// 其他线程在顶部steal. 所有者的push不需要原子读改写, pop只在与窃取者争最后一个元素时CAS.
+// 容量取不小于capacity的2的幂, 满时push返回false, 由调用者退回其他队列.
+template <typename T>
+class ws_deque {
+public:
+    static const size_t CACHE_LINE = 64;
+
+    explicit ws_deque(size_t capacity) : buffer_(round_up(capacity)), mask_(buffer_.size() - 1) {
+        if (capacity == 0) {
+            throw std::exception();
+        }
+        top_.store(0, std::memory_order_relaxed);
+        bottom_.store(0, std::memory_order_relaxed);
+    }
+
+    // 仅所有者调用, 队列满时返回false
+    bool push(T value) {
+        long b = bottom_.load(std::memory_order_relaxed);
+        long t = top_.load(std::memory_order_acquire);
+        if (b - t > (long)mask_) {
+            return false;
+        }
+        buffer_[b & mask_].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 仅所有者调用, 从底部取最近放入的元素, 队列空时返回false
+    bool pop(T& value) {
+        long b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = buffer_[b & mask_].load(std::memory_order_relaxed);
+        if (t == b) {
+            // 最后一个元素, 与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用, 从顶部取最早放入的元素; 队列空或与其他线程竞争失败时返回false
+    bool steal(T& value) {
+        long t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        value = buffer_[t & mask_].load(std::memory_order_relaxed);
+        return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    // 近似的元素个数, 用于决定窃取多少和休眠前的检查
+    size_t size_approx() const {
+        long b = bottom_.load(std::memory_order_relaxed);
+        long t = top_.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    // 禁止拷贝和赋值
+    ws_deque(const ws_deque&) = delete;
+    ws_deque& operator=(const ws_deque&) = delete;
+
+private:
+    static size_t round_up(size_t n) {
+        size_t size = 2;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+private:
+    // 与mpmc_queue相同, 用填充隔开顶部和底部, 窃取者改写top_时不使所有者的bottom_所在缓存行失效
+    char pad0_[CACHE_LINE];
+    std::atomic<long> top_;
+    char pad1_[CACHE_LINE - sizeof(std::atomic<long>)];
+    std::atomic<long> bottom_;
+    char pad2_[CACHE_LINE - sizeof(std::atomic<long>)];
+    std::vector<std::atomic<T>> buffer_;
+    size_t mask_;
+};
+
+#endif // WS_DEQUE_HPP
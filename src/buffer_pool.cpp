@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include "buffer_pool.hpp"
+
+buffer_pool::~buffer_pool() {
+    for (int i = 0; i < CLASSES; ++i) {
+        for (size_t j = 0; j < lists_[i].blocks.size(); ++j) {
+            ::free(lists_[i].blocks[j]);
+        }
+    }
+}
+
+buffer_pool::local_cache::~local_cache() {
+    buffer_pool* pool = buffer_pool::get_instance();
+    for (int i = 0; i < CLASSES; ++i) {
+        pool->lists_[i].lock.lock();
+        pool->lists_[i].blocks.insert(pool->lists_[i].blocks.end(), blocks[i].begin(), blocks[i].end());
+        pool->lists_[i].lock.unlock();
+    }
+}
+
+buffer_pool::local_cache& buffer_pool::local() {
+    static thread_local local_cache cache;
+    return cache;
+}
+
+int buffer_pool::class_of(size_t size) {
+    int cls = 0;
+    while (cls < CLASSES && (MIN_SIZE << cls) < size) {
+        ++cls;
+    }
+    return cls;
+}
+
+char* buffer_pool::alloc(size_t& size) {
+    int cls = class_of(size);
+    if (cls >= CLASSES) {
+        return nullptr;
+    }
+    size = MIN_SIZE << cls;
+
+    std::vector<char*>& cache = local().blocks[cls];
+    if (!cache.empty()) {
+        char* buf = cache.back();
+        cache.pop_back();
+        return buf;
+    }
+
+    // 本线程缓存为空, 从全局链表批量取一半缓存容量
+    free_list& list = lists_[cls];
+    list.lock.lock();
+    size_t n = list.blocks.size() < LOCAL_CACHE / 2 ? list.blocks.size() : LOCAL_CACHE / 2;
+    cache.insert(cache.end(), list.blocks.end() - n, list.blocks.end());
+    list.blocks.resize(list.blocks.size() - n);
+    list.lock.unlock();
+
+    if (!cache.empty()) {
+        char* buf = cache.back();
+        cache.pop_back();
+        return buf;
+    }
+    return static_cast<char*>(malloc(size));
+}
+
+void buffer_pool::free(char* buf, size_t size) {
+    if (!buf) {
+        return;
+    }
+    int cls = class_of(size);
+    std::vector<char*>& cache = local().blocks[cls];
+    if (cache.size() < (size_t)LOCAL_CACHE) {
+        cache.push_back(buf);
+        return;
+    }
+
+    // 本线程缓存已满, 把一半还给全局链表
+    free_list& list = lists_[cls];
+    list.lock.lock();
+    list.blocks.insert(list.blocks.end(), cache.end() - LOCAL_CACHE / 2, cache.end());
+    list.lock.unlock();
+    cache.resize(LOCAL_CACHE / 2);
+    cache.push_back(buf);
+}
@@ -0,0 +1,51 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include "config.hpp"
+
+Config::Config() {
+    port = 9006;        // 端口号, 默认9006
+    log_write = 0;      // 日志写入方式, 默认同步
+    trig_mode = 0;      // 触发组合模式, 默认listenfd LT + connfd LT
+    opt_linger = 0;     // 优雅关闭连接, 默认不使用
+    sql_num = 8;        // 数据库连接池数量, 默认8
+    thread_num = 8;     // 线程池内的线程数量, 默认8
+    min_thread = 0;     // 线程池线程数下限, 默认不伸缩
+    close_log = 0;      // 关闭日志, 默认不关闭
+    actor_model = 0;    // 并发模型, 默认是proactor
+    reactor_num = 0;    // 多reactor事件循环数量, 默认不开启
+    io_backend = 0;     // I/O后端, 默认epoll
+    zero_copy = 0;      // 静态文件发送方式, 默认mmap+writev
+    file_cache_mb = 0;  // 静态文件缓存, 默认不开启
+    work_stealing = 0;  // 线程池任务分发, 默认共享队列
+    cpu_affinity = 0;   // 线程绑核, 默认不绑
+    max_conn = 0;       // 连接总数上限, 默认MAX_FD
+    queue_deadline_ms = 0;  // 排队期限, 默认不限
+}
+
+void Config::parse_arg(int argc, char* argv[]) {
+    int opt;
+    const char* str = "p:l:m:o:s:t:n:c:a:r:i:z:f:w:b:N:C:D:";
+    while ((opt = getopt(argc, argv, str)) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'l': log_write = atoi(optarg); break;
+        case 'm': trig_mode = atoi(optarg); break;
+        case 'o': opt_linger = atoi(optarg); break;
+        case 's': sql_num = atoi(optarg); break;
+        case 't': thread_num = atoi(optarg); break;
+        case 'n': min_thread = atoi(optarg); break;
+        case 'c': close_log = atoi(optarg); break;
+        case 'a': actor_model = atoi(optarg); break;
+        case 'r': reactor_num = atoi(optarg); break;
+        case 'i': io_backend = atoi(optarg); break;
+        case 'z': zero_copy = atoi(optarg); break;
+        case 'f': file_cache_mb = atoi(optarg); break;
+        case 'w': work_stealing = atoi(optarg); break;
+        case 'b': cpu_affinity = atoi(optarg); break;
+        case 'N': nic = optarg; break;
+        case 'C': max_conn = atoi(optarg); break;
+        case 'D': queue_deadline_ms = atoi(optarg); break;
+        default: break;
+        }
+    }
+}
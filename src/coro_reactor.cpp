@@ -0,0 +1,435 @@
+// 本文件按C++20编译(见CMakeLists.txt), 只有这里用到协程
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include "coro_reactor.hpp"
+#include "cpu_topology.hpp"
+
+namespace {
+
+// 协程帧的线程本地池: 帧按64字节分级, 释放的帧留在本线程的空闲链表中, 下一个连接直接复用.
+// 连接协程只在所属事件循环线程上创建、恢复和结束, 分配和释放都在同一线程, 不需要加锁
+class frame_pool {
+public:
+    static const size_t GRAIN = 64;
+    static const int CLASSES = 32;          // 2KB以内的帧走池
+    static const size_t LOCAL_CACHE = 4096; // 每级最多缓存的帧数
+
+    static void* alloc(size_t size) {
+        size_t cls = (size + GRAIN - 1) / GRAIN;
+        if (cls < (size_t)CLASSES) {
+            std::vector<void*>& list = local().frees_[cls];
+            if (!list.empty()) {
+                void* p = list.back();
+                list.pop_back();
+                return p;
+            }
+            return ::operator new(cls * GRAIN);
+        }
+        return ::operator new(size);
+    }
+
+    static void free(void* p, size_t size) {
+        size_t cls = (size + GRAIN - 1) / GRAIN;
+        if (cls < (size_t)CLASSES) {
+            std::vector<void*>& list = local().frees_[cls];
+            if (list.size() < LOCAL_CACHE) {
+                list.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+private:
+    ~frame_pool() {
+        for (int i = 0; i < CLASSES; ++i) {
+            for (size_t j = 0; j < frees_[i].size(); ++j) {
+                ::operator delete(frees_[i][j]);
+            }
+        }
+    }
+
+    static frame_pool& local() {
+        static thread_local frame_pool pool;
+        return pool;
+    }
+
+    std::vector<void*> frees_[CLASSES];
+};
+
+// 协程开始时取得自己的句柄, 不挂起
+struct self_handle {
+    std::coroutine_handle<> handle;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+        handle = h;
+        return false;
+    }
+    std::coroutine_handle<> await_resume() const noexcept { return handle; }
+};
+
+} // namespace
+
+// 连接协程创建后立即运行到第一次挂起, 结束时帧自动释放, 没有调用者等待它的结果
+struct conn_task {
+    struct promise_type {
+        conn_task get_return_object() noexcept { return conn_task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(size_t size) { return frame_pool::alloc(size); }
+        static void operator delete(void* p, size_t size) { frame_pool::free(p, size); }
+    };
+};
+
+// 挂起直到fd可读(或可写); 可能被同一fd上的过时事件提前唤醒, 调用者重试I/O即可
+struct io_awaiter {
+    coro_reactor* loop;
+    int fd;
+    bool write;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) noexcept {
+        (write ? loop->writers_ : loop->readers_)[fd] = h.address();
+    }
+    void await_resume() const noexcept {}
+};
+
+// 需要数据库的请求交给数据库车道: 车道线程取连接、解析并准备响应, 然后把协程交回所属事件循环.
+// 满足threadpool对任务类型的要求; 作为等待体放在协程帧里, 协程恢复后随协程帧一起销毁.
+// 车道的threadpool不带连接池, 连接在process内取得并归还. 车道对任务的最后一次访问是mark_returned
+// (处理完或被丢弃), 协程在那里才交回, 之前车道仍可能访问本对象
+struct db_call {
+    static const int BUSY = -2;     // 车道队列已满
+
+    // threadpool要求的字段, 数据库车道为proactor模式, 只用到enqueue_ms_和mysql_
+    int state_;
+    std::atomic<int> improv;
+    std::atomic<int> timer_flag;
+    uint64_t enqueue_ms_;
+    MYSQL* mysql_;
+
+    coro_reactor* loop;
+    http_conn* conn;
+    std::coroutine_handle<> handle;
+    int result;
+
+    db_call(coro_reactor* l, http_conn* c)
+        : state_(0), improv(0), timer_flag(0), enqueue_ms_(0), mysql_(nullptr), loop(l), conn(c), result(-1) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        handle = h;
+        if (!loop->db_lane_->append_p(this)) {
+            result = BUSY;
+            return false;
+        }
+        ++loop->offloaded_;
+        return true;
+    }
+    int await_resume() const noexcept { return result; }
+
+    void process() {
+        connectionRAII mysqlcon(&conn->mysql_, loop->conn_pool_);
+        result = conn->prepare_response();
+    }
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    bool has_pending_input() const { return false; }
+    bool needs_db() const { return false; }
+    void shed() {}
+    void request_close() {}
+    // 车道不再访问本对象, 把协程交回所属事件循环; 被车道丢弃时result仍为-1, 协程关闭连接
+    void mark_returned() {
+        coro_reactor* home = loop;
+        void* h = handle.address();
+        home->post_ready(h);    // 此后协程可能已恢复, 不能再访问本对象
+    }
+};
+
+coro_reactor::coro_reactor()
+    : id_(0), port_(0), listenfd_(-1), epollfd_(-1), wakeup_fd_(-1), thread_(0), cpu_(-1), steer_incoming_(false),
+      stop_(false), users_(nullptr), max_fd_(0), conn_config_(nullptr), opt_linger_(0), close_log_(0),
+      conn_pool_(nullptr), db_threads_(1), db_lane_(nullptr), ready_(2 * DB_QUEUE), offloaded_(0), timers_(nullptr),
+      now_ms_(0), user_count_(0), request_count_(0)
+{
+}
+
+coro_reactor::~coro_reactor() {
+    delete db_lane_;
+    if (listenfd_ != -1) close(listenfd_);
+    if (epollfd_ != -1) close(epollfd_);
+    if (wakeup_fd_ != -1) close(wakeup_fd_);
+    delete timers_;
+}
+
+void coro_reactor::init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int opt_linger,
+                        connection_pool* conn_pool, int db_threads) {
+    id_ = id;
+    port_ = port;
+    users_ = users;
+    max_fd_ = max_fd;
+    conn_config_ = conn_config;
+    opt_linger_ = opt_linger;
+    close_log_ = conn_config->close_log;
+    conn_pool_ = conn_pool;
+    db_threads_ = db_threads > 0 ? db_threads : 1;
+}
+
+bool coro_reactor::start() {
+    listenfd_ = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listenfd_ < 0) {
+        return false;
+    }
+
+    // 优雅关闭连接
+    struct linger tmp = {opt_linger_ == 1 ? 1 : 0, 1};
+    setsockopt(listenfd_, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+
+    // 每个事件循环绑定同一端口, 由内核在监听socket之间分摊新连接
+    int flag = 1;
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    // 内核6.2起在SO_REUSEPORT组内优先选择incoming cpu与收包CPU相同的监听socket
+    if (steer_incoming_ && cpu_ >= 0)
+        setsockopt(listenfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu_, sizeof(cpu_));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port_);
+    if (bind(listenfd_, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenfd_, 5) < 0) {
+        LOG_ERROR("coro reactor %d listen error: errno is %d", id_, errno);
+        return false;
+    }
+
+    epollfd_ = epoll_create(5);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (epollfd_ == -1 || wakeup_fd_ == -1) {
+        return false;
+    }
+    addfd(epollfd_, listenfd_, false, 0);
+    addfd(epollfd_, wakeup_fd_, false, 0);
+
+    db_lane_ = new threadpool<db_call>(0, nullptr, db_threads_, DB_QUEUE);
+    if (cpu_topology::create_thread(&thread_, cpu_, worker, this) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void coro_reactor::stop() {
+    stop_ = true;
+    uint64_t one = 1;
+    if (wakeup_fd_ != -1) {
+        ::write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+void coro_reactor::join() {
+    if (thread_) {
+        pthread_join(thread_, nullptr);
+        thread_ = 0;
+    }
+}
+
+void* coro_reactor::worker(void* arg) {
+    coro_reactor* loop = static_cast<coro_reactor*>(arg);
+    loop->run();
+    return loop;
+}
+
+void coro_reactor::deal_client_data() {
+    // 监听socket为LT, 这里仍一次取完, 减少epoll_wait次数
+    while (true) {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        int connfd = accept4(listenfd_, (struct sockaddr*)&client_address, &client_addrlength, SOCK_NONBLOCK);
+        if (connfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            }
+            return;
+        }
+        if (connfd >= max_fd_ || http_conn::user_count_ >= conn_config_->max_conn) {
+            // 连接数已到上限, 回复503后关闭
+            http_conn::send_busy(connfd);
+            close(connfd);
+            LOG_ERROR("%s", "Internal server busy");
+            continue;
+        }
+        // 读按ET方式一次读到EAGAIN, 连接对象不操作epoll, 可读可写事件都以ET方式注册一次, 之后不再修改
+        users_[connfd].init(connfd, client_address, conn_config_, 1, -1, &user_count_);
+        epoll_event event;
+        event.data.fd = connfd;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        epoll_ctl(epollfd_, EPOLL_CTL_ADD, connfd, &event);
+        timers_->add(connfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+        serve(connfd);
+    }
+}
+
+conn_task coro_reactor::serve(int fd) {
+    frames_[fd] = (co_await self_handle{}).address();
+    http_conn* conn = users_ + fd;
+    while (true) {
+        if (!conn->read_once()) {
+            break;
+        }
+        if (!conn->has_pending_input()) {
+            co_await io_awaiter{this, fd, false};
+            continue;
+        }
+        ++request_count_;
+        timers_->adjust(fd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+
+        int ret;
+        if (conn->needs_db()) {
+            ret = co_await db_call(this, conn);
+            if (ret == db_call::BUSY) {
+                conn->shed();
+                break;
+            }
+        } else {
+            ret = conn->prepare_response();
+        }
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            // 请求不完整, 等待更多数据
+            co_await io_awaiter{this, fd, false};
+            continue;
+        }
+
+        // 发送本批响应, 发送缓冲区满时挂起等待可写
+        bool sent = false;
+        while (true) {
+            int n = writev(fd, conn->write_iov(), conn->write_iov_count());
+            if (n < 0) {
+                if (errno == EAGAIN) {
+                    co_await io_awaiter{this, fd, true};
+                    continue;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (conn->advance_write(n)) {
+                sent = true;
+                break;
+            }
+        }
+        if (!conn->finish_write() || !sent) {
+            break;
+        }
+        timers_->adjust(fd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    }
+    frames_[fd] = nullptr;
+    close_conn(fd);
+}
+
+void coro_reactor::resume(void*& waiter) {
+    void* h = waiter;
+    if (h) {
+        waiter = nullptr;
+        std::coroutine_handle<>::from_address(h).resume();
+    }
+}
+
+void coro_reactor::post_ready(void* handle) {
+    // 容量是车道队列的两倍, 在途的协程数不会超过它; 放不下时说明事件循环落后, 等它取走
+    while (!ready_.try_push(handle)) {
+        cpu_relax();
+    }
+    uint64_t one = 1;
+    ::write(wakeup_fd_, &one, sizeof(one));
+}
+
+void coro_reactor::drain_ready() {
+    uint64_t cnt;
+    ::read(wakeup_fd_, &cnt, sizeof(cnt));
+    void* h;
+    while (ready_.try_pop(h)) {
+        --offloaded_;
+        std::coroutine_handle<>::from_address(h).resume();
+    }
+}
+
+void coro_reactor::close_conn(int fd) {
+    timers_->remove(fd);
+    readers_[fd] = nullptr;
+    writers_[fd] = nullptr;
+    users_[fd].close_conn();
+}
+
+void coro_reactor::run() {
+    // 等待表和时间轮按最大描述符数分配, 在本线程内首次写入, 绑核时落在本线程所在的NUMA节点上
+    readers_.assign(max_fd_, nullptr);
+    writers_.assign(max_fd_, nullptr);
+    frames_.assign(max_fd_, nullptr);
+    timers_ = new timer_wheel(max_fd_);
+    std::vector<epoll_event> events(MAX_EVENTS);
+
+    while (!stop_) {
+        int timeout = timers_->next_timeout(timer_wheel::now_ms());
+        int number = epoll_wait(epollfd_, events.data(), MAX_EVENTS, timeout);
+        if (number < 0 && errno != EINTR) {
+            LOG_ERROR("coro reactor %d epoll failure", id_);
+            break;
+        }
+        now_ms_ = timer_wheel::now_ms();
+
+        for (int i = 0; i < number; i++) {
+            int sockfd = events[i].data.fd;
+            uint32_t ev = events[i].events;
+            if (sockfd == listenfd_) {
+                deal_client_data();
+            } else if (sockfd == wakeup_fd_) {
+                drain_ready();
+            } else {
+                // 出错和对端关闭时两边的等待者都恢复, 由它们的I/O调用发现并结束协程
+                if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    resume(readers_[sockfd]);
+                }
+                if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                    resume(writers_[sockfd]);
+                }
+            }
+        }
+
+        // 超时的非活动连接: 关闭读写两端, 挂起的协程随即被唤醒并自行结束; 正在数据库车道上的协程回来后结束
+        timers_->tick(now_ms_, [this](int sockfd) {
+            LOG_INFO("close idle connection %d", sockfd);
+            shutdown(sockfd, SHUT_RDWR);
+        });
+    }
+
+    // 先等数据库车道上的协程回来, 车道线程不再访问连接对象, 再销毁所有挂起的协程
+    while (offloaded_ > 0) {
+        drain_ready();
+        if (offloaded_ > 0) {
+            usleep(1000);
+        }
+    }
+    for (int fd = 0; fd < max_fd_; ++fd) {
+        if (frames_[fd]) {
+            std::coroutine_handle<>::from_address(frames_[fd]).destroy();
+            frames_[fd] = nullptr;
+            close_conn(fd);
+        }
+    }
+    LOG_INFO("coro reactor %d exit, connections: %d, reads: %lld", id_, user_count_, request_count_);
+}
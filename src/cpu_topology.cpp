@@ -0,0 +1,233 @@
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include "cpu_topology.hpp"
+
+// 读取整个小文件, 去掉末尾换行; 读不到返回false
+static bool read_file(const std::string& path, std::string* out) {
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp)
+        return false;
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+        buf[--n] = '\0';
+    out->assign(buf, n);
+    return true;
+}
+
+static int read_int(const std::string& path, int fallback) {
+    std::string s;
+    if (!read_file(path, &s) || s.empty())
+        return fallback;
+    return atoi(s.c_str());
+}
+
+// 目录下以prefix开头、其后全是数字的项, 返回数字部分并排序
+static std::vector<int> numbered_entries(const std::string& dir, const char* prefix) {
+    std::vector<int> ids;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return ids;
+    size_t len = strlen(prefix);
+    while (struct dirent* e = readdir(d)) {
+        const char* name = e->d_name;
+        if (strncmp(name, prefix, len) != 0 || name[len] == '\0')
+            continue;
+        char* end;
+        long id = strtol(name + len, &end, 10);
+        if (*end == '\0')
+            ids.push_back((int)id);
+    }
+    closedir(d);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+std::vector<int> cpu_topology::parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    const char* p = list.c_str();
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1)
+                break;
+            p = end;
+        }
+        for (long c = first; c <= last && c < CPU_SETSIZE; ++c)
+            cpus.push_back((int)c);
+        if (*p != ',')
+            break;
+        ++p;
+    }
+    return cpus;
+}
+
+bool cpu_topology::load(const std::string& sysfs_root, const cpu_set_t* allowed) {
+    sysfs_root_ = sysfs_root;
+    cpus_.clear();
+    placement_.clear();
+    const std::string cpu_dir = sysfs_root + "/devices/system/cpu";
+
+    std::string online;
+    std::vector<int> ids;
+    if (read_file(cpu_dir + "/online", &online))
+        ids = parse_cpu_list(online);
+    bool from_sysfs = !ids.empty();
+    if (!from_sysfs) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n; ++i)
+            ids.push_back((int)i);
+    }
+
+    // 只保留本进程允许运行的CPU(taskset/cpuset限制)
+    cpu_set_t mask;
+    if (allowed || sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        if (!allowed)
+            allowed = &mask;
+        std::vector<int> kept;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (CPU_ISSET(ids[i], allowed))
+                kept.push_back(ids[i]);
+        }
+        if (!kept.empty())
+            ids.swap(kept);
+    }
+
+    // CPU到NUMA节点的映射, 没有node目录的内核视为单节点
+    std::map<int, int> node_of_cpu;
+    const std::string node_dir = sysfs_root + "/devices/system/node";
+    std::vector<int> nodes = numbered_entries(node_dir, "node");
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        std::string list;
+        char name[32];
+        snprintf(name, sizeof(name), "/node%d/cpulist", nodes[i]);
+        if (!read_file(node_dir + name, &list))
+            continue;
+        std::vector<int> cpus = parse_cpu_list(list);
+        for (size_t j = 0; j < cpus.size(); ++j)
+            node_of_cpu[cpus[j]] = nodes[i];
+    }
+
+    std::set<int> used_nodes;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        cpu_info info;
+        info.cpu = ids[i];
+        std::map<int, int>::const_iterator it = node_of_cpu.find(ids[i]);
+        info.node = it == node_of_cpu.end() ? 0 : it->second;
+        char name[64];
+        snprintf(name, sizeof(name), "/cpu%d/topology/physical_package_id", ids[i]);
+        info.package = read_int(cpu_dir + name, 0);
+        snprintf(name, sizeof(name), "/cpu%d/topology/core_id", ids[i]);
+        info.core = read_int(cpu_dir + name, ids[i]);
+        cpus_.push_back(info);
+        used_nodes.insert(info.node);
+    }
+    node_count_ = used_nodes.empty() ? 1 : (int)used_nodes.size();
+
+    // 同一物理核上编号最小的超线程排在前面, 其余超线程排在本节点的最后
+    std::map<std::pair<int, int>, int> first_of_core;
+    for (size_t i = 0; i < cpus_.size(); ++i) {
+        std::pair<int, int> key(cpus_[i].package, cpus_[i].core);
+        if (!first_of_core.count(key) || cpus_[i].cpu < first_of_core[key])
+            first_of_core[key] = cpus_[i].cpu;
+    }
+    std::vector<cpu_info> order(cpus_);
+    std::sort(order.begin(), order.end(), [&first_of_core](const cpu_info& a, const cpu_info& b) {
+        if (a.node != b.node)
+            return a.node < b.node;
+        bool a_sibling = first_of_core[std::make_pair(a.package, a.core)] != a.cpu;
+        bool b_sibling = first_of_core[std::make_pair(b.package, b.core)] != b.cpu;
+        if (a_sibling != b_sibling)
+            return !a_sibling;
+        return a.cpu < b.cpu;
+    });
+    for (size_t i = 0; i < order.size(); ++i)
+        placement_.push_back(order[i].cpu);
+    return from_sysfs;
+}
+
+int cpu_topology::node_of(int cpu) const {
+    for (size_t i = 0; i < cpus_.size(); ++i) {
+        if (cpus_[i].cpu == cpu)
+            return cpus_[i].node;
+    }
+    return 0;
+}
+
+std::vector<int> cpu_topology::nic_irq_cpus(const std::string& ifname, const std::string& proc_root) const {
+    std::vector<int> result;
+    std::vector<int> irqs = numbered_entries(sysfs_root_ + "/class/net/" + ifname + "/device/msi_irqs", "");
+    for (size_t i = 0; i < irqs.size(); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "/irq/%d/", irqs[i]);
+        std::string list;
+        if ((!read_file(proc_root + name + "effective_affinity_list", &list) || list.empty()) &&
+            !read_file(proc_root + name + "smp_affinity_list", &list))
+            continue;
+        std::vector<int> cpus = parse_cpu_list(list);
+        if (cpus.empty())
+            continue;
+        // 中断允许多个CPU时取第一个, 只保留本进程可用且没有出现过的CPU
+        int cpu = cpus[0];
+        bool usable = false;
+        for (size_t j = 0; j < cpus_.size(); ++j) {
+            if (cpus_[j].cpu == cpu)
+                usable = true;
+        }
+        if (usable && std::find(result.begin(), result.end(), cpu) == result.end())
+            result.push_back(cpu);
+    }
+    return result;
+}
+
+bool cpu_topology::pin_thread(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+int cpu_topology::create_thread(pthread_t* thread, int cpu, void* (*fn)(void*), void* arg) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int ret = pthread_create(thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+bool cpu_topology::bind_memory(void* addr, size_t len, const std::vector<int>& nodes) {
+    if (nodes.empty())
+        return false;
+    unsigned long mask[4] = {0, 0, 0, 0};
+    const unsigned long bits = sizeof(mask[0]) * 8;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i] < 0 || nodes[i] >= (int)(bits * 4))
+            return false;
+        mask[nodes[i] / bits] |= 1UL << (nodes[i] % bits);
+    }
+    int mode = nodes.size() == 1 ? MPOL_PREFERRED : MPOL_INTERLEAVE;
+    return syscall(SYS_mbind, addr, len, mode, mask, bits * 4 + 1, MPOL_MF_MOVE) == 0;
+}
@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <functional>
+#include "file_cache.hpp"
+#include "http_response.hpp"
+
+file_cache::entry::~entry() {
+    if (addr) munmap(addr, st.st_size);
+    if (fd != -1) close(fd);
+}
+
+file_cache::file_cache() : enabled_(false), shard_budget_(0), inotify_fd_(-1) {
+}
+
+file_cache::~file_cache() {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        delete shards_[i];
+    }
+    if (inotify_fd_ != -1) close(inotify_fd_);
+}
+
+bool file_cache::init(size_t budget, int shard_num) {
+    if (budget == 0 || shard_num <= 0) {
+        return false;
+    }
+    // 没有inotify就无法感知文件变化, 不启用缓存
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        return false;
+    }
+    for (int i = 0; i < shard_num; ++i) {
+        shards_.push_back(new shard);
+    }
+    shard_budget_ = budget / shard_num;
+
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, watch_thread, this) != 0) {
+        return false;
+    }
+    pthread_detach(tid);
+    enabled_ = true;
+    return true;
+}
+
+file_cache::shard& file_cache::shard_for(const std::string& path) {
+    return *shards_[std::hash<std::string>()(path) % shards_.size()];
+}
+
+file_cache::entry_ptr file_cache::get(const char* path) {
+    if (!enabled_) {
+        return entry_ptr();
+    }
+    std::string key(path);
+    shard& s = shard_for(key);
+
+    s.lock.lock();
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+        // 命中: 移到LRU表头
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        entry_ptr e = *it->second;
+        s.lock.unlock();
+        return e;
+    }
+    s.lock.unlock();
+
+    entry_ptr e = load(key);
+    if (!e) {
+        return e;
+    }
+
+    s.lock.lock();
+    // 并发加载同一文件时保留先插入的一份
+    it = s.index.find(key);
+    if (it != s.index.end()) {
+        entry_ptr exist = *it->second;
+        s.lock.unlock();
+        return exist;
+    }
+    // 加载期间watch已经触发: 文件可能已变化且不会再有通知, 不缓存, 由调用者走普通路径.
+    // 检查和插入都在分片锁内, 之后触发的事件要等插入完成才能执行invalidate
+    if (!watching(e->wd)) {
+        s.lock.unlock();
+        return entry_ptr();
+    }
+    s.lru.push_front(e);
+    s.index[key] = s.lru.begin();
+    s.bytes += e->st.st_size;
+    evict(s);
+    s.lock.unlock();
+    return e;
+}
+
+file_cache::entry_ptr file_cache::load(const std::string& path) {
+    // 先装watch再stat和打开, 之后文件的任何修改、替换或删除都会产生事件; 文件不存在时这里就会失败
+    int wd = inotify_add_watch(inotify_fd_, path.c_str(),
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONESHOT);
+    if (wd < 0) {
+        return entry_ptr();
+    }
+    watch_lock_.lock();
+    watches_[wd] = path;
+    watch_lock_.unlock();
+
+    std::shared_ptr<entry> e = std::make_shared<entry>();
+    e->path = path;
+    e->wd = wd;
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !(st.st_mode & S_IROTH) || !S_ISREG(st.st_mode) ||
+        (size_t)st.st_size > shard_budget_) {
+        drop_watch(wd);
+        return entry_ptr();
+    }
+    e->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    // 以打开的文件为准, stat之后被替换时放弃
+    if (e->fd < 0 || fstat(e->fd, &e->st) < 0 || e->st.st_ino != st.st_ino || e->st.st_dev != st.st_dev ||
+        (size_t)e->st.st_size > shard_budget_) {
+        drop_watch(wd);
+        return entry_ptr();
+    }
+    if (e->st.st_size > 0) {
+        void* addr = mmap(0, e->st.st_size, PROT_READ, MAP_PRIVATE, e->fd, 0);
+        if (addr == MAP_FAILED) {
+            drop_watch(wd);
+            return entry_ptr();
+        }
+        e->addr = static_cast<char*>(addr);
+    }
+
+    // 缓存项在文件变化时失效, 可以一直使用强校验器
+    char etag[48], last_modified[32], header[256];
+    format_etag(e->st, false, etag, sizeof(etag));
+    http_response::format_http_date(e->st.st_mtime, last_modified, sizeof(last_modified));
+    e->etag = etag;
+    e->last_modified = last_modified;
+    const http_response::text& type = http_response::mime_type(path.data(), path.size());
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\nAccept-Ranges:bytes\r\nContent-Type:%s\r\nETag:%s\r\nLast-Modified:%s\r\nContent-Length:%ld\r\n",
+                       type.data, etag, last_modified, (long)e->st.st_size);
+    e->header.assign(header, len);
+    return e;
+}
+
+bool file_cache::watching(int wd) {
+    watch_lock_.lock();
+    bool found = watches_.count(wd) != 0;
+    watch_lock_.unlock();
+    return found;
+}
+
+void file_cache::drop_watch(int wd) {
+    watch_lock_.lock();
+    bool found = watches_.erase(wd) != 0;
+    watch_lock_.unlock();
+    // 已触发的watch由内核移除
+    if (found) {
+        inotify_rm_watch(inotify_fd_, wd);
+    }
+}
+
+// 超出预算时从LRU表尾淘汰, 正在发送的连接仍持有引用, 映射在其释放后才解除
+void file_cache::evict(shard& s) {
+    while (s.bytes > shard_budget_ && !s.lru.empty()) {
+        entry_ptr victim = s.lru.back();
+        s.lru.pop_back();
+        s.index.erase(victim->path);
+        s.bytes -= victim->st.st_size;
+        drop_watch(victim->wd);
+    }
+}
+
+void file_cache::invalidate(const std::string& path) {
+    shard& s = shard_for(path);
+    s.lock.lock();
+    auto it = s.index.find(path);
+    if (it != s.index.end()) {
+        entry_ptr victim = *it->second;
+        s.bytes -= victim->st.st_size;
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    }
+    s.lock.unlock();
+}
+
+void* file_cache::watch_thread(void* arg) {
+    static_cast<file_cache*>(arg)->watch_loop();
+    return nullptr;
+}
+
+void file_cache::watch_loop() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        for (char* p = buf; p < buf + len;) {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            std::string path;
+            watch_lock_.lock();
+            auto it = watches_.find(ev->wd);
+            if (it != watches_.end()) {
+                path = it->second;
+                // IN_ONESHOT的watch触发一次后由内核移除
+                watches_.erase(it);
+            }
+            watch_lock_.unlock();
+            if (!path.empty()) {
+                invalidate(path);
+            }
+        }
+    }
+}
+
+int file_cache::format_etag(const struct stat& st, bool weak, char* buf, size_t size) {
+    unsigned long long mtime = (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    return snprintf(buf, size, "%s\"%llx-%llx-%llx\"", weak ? "W/" : "",
+                    (unsigned long long)st.st_ino, (unsigned long long)st.st_size, mtime);
+}
+
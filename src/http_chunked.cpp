@@ -0,0 +1,132 @@
+#include <string.h>
+#include "http_chunked.hpp"
+
+const char http_chunked::LAST_CHUNK[] = "0\r\n\r\n";
+
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+void http_chunked::decoder::reset() {
+    state_ = SIZE;
+    remaining_ = 0;
+    has_digit_ = false;
+}
+
+http_chunked::STATUS http_chunked::decoder::decode(const char* in, long len, long* used, char* out, long out_room,
+                                                  long* produced) {
+    long i = 0;
+    long n = 0;
+    while (i < len) {
+        char c = in[i];
+        switch (state_) {
+        case SIZE: {
+            int v = hex_value(c);
+            if (v >= 0) {
+                remaining_ = remaining_ * 16 + v;
+                if (remaining_ > MAX_CHUNK_SIZE)
+                    return CHUNK_BAD;
+                has_digit_ = true;
+                ++i;
+                continue;
+            }
+            if (!has_digit_)
+                return CHUNK_BAD;
+            if (c == ';' || c == ' ' || c == '\t')
+                state_ = SIZE_EXT;
+            else if (c == '\r')
+                state_ = SIZE_LF;
+            else if (c == '\n')
+                state_ = remaining_ ? DATA : TRAILER;
+            else
+                return CHUNK_BAD;
+            break;
+        }
+        case SIZE_EXT:
+            if (c == '\r')
+                state_ = SIZE_LF;
+            else if (c == '\n')
+                state_ = remaining_ ? DATA : TRAILER;
+            break;
+        case SIZE_LF:
+            if (c != '\n')
+                return CHUNK_BAD;
+            state_ = remaining_ ? DATA : TRAILER;
+            break;
+        case DATA: {
+            // 整段拷贝, 输出写满时停在这里等调用者换更大的缓冲区
+            long k = len - i;
+            if (k > remaining_)
+                k = remaining_;
+            if (k > out_room - n)
+                k = out_room - n;
+            if (k == 0) {
+                *used = i;
+                *produced = n;
+                return CHUNK_MORE;
+            }
+            memcpy(out + n, in + i, k);
+            n += k;
+            i += k;
+            remaining_ -= k;
+            if (remaining_ == 0)
+                state_ = DATA_CR;
+            continue;
+        }
+        case DATA_CR:
+            if (c == '\r')
+                state_ = DATA_LF;
+            else if (c == '\n')
+                reset();
+            else
+                return CHUNK_BAD;
+            break;
+        case DATA_LF:
+            if (c != '\n')
+                return CHUNK_BAD;
+            reset();
+            break;
+        case TRAILER:
+            if (c == '\r')
+                state_ = FINAL_LF;
+            else if (c == '\n') {
+                *used = i + 1;
+                *produced = n;
+                return CHUNK_DONE;
+            } else
+                state_ = TRAILER_LINE;
+            break;
+        case TRAILER_LINE:
+            if (c == '\n')
+                state_ = TRAILER;
+            break;
+        case FINAL_LF:
+            if (c != '\n')
+                return CHUNK_BAD;
+            *used = i + 1;
+            *produced = n;
+            return CHUNK_DONE;
+        }
+        ++i;
+    }
+    *used = i;
+    *produced = n;
+    return CHUNK_MORE;
+}
+
+int http_chunked::prepend_chunk_head(char* head, long size) {
+    static const char digits[] = "0123456789abcdef";
+    char* p = head;
+    *--p = '\n';
+    *--p = '\r';
+    do {
+        *--p = digits[size & 15];
+        size >>= 4;
+    } while (size);
+    return head - p;
+}
@@ -1,24 +1,25 @@
 #include <cstdio>
-#include <cstdarg>
 #include "http_conn.hpp"
+#include "http_scan.hpp"
+#include "http_response.hpp"
+#include "http_chunked.hpp"
 #include "string.h"
 #include <sys/epoll.h>
 #include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 
 
-// 定义http响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
-const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
-const char *error_403_title = "Forbidden";
-const char *error_403_form = "You do not have permission to get file form this server.\n";
-const char *error_404_title = "Not Found";
-const char *error_404_form = "The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
-const char *error_500_form = "There was an unusual problem serving the request file.\n";
+// 多范围响应multipart/byteranges的分隔符及固定片段
+#define RANGE_BOUNDARY "7d4a1f08c3b9e265"
+static const char range_content_type[] = "Content-Type:multipart/byteranges; boundary=" RANGE_BOUNDARY "\r\n";
+static const int range_content_type_len = sizeof(range_content_type) - 1;
+static const char range_part[] = "\r\n--" RANGE_BOUNDARY "\r\nContent-Type:";
+static const int range_part_len = sizeof(range_part) - 1;
+static const char range_tail[] = "\r\n--" RANGE_BOUNDARY "--\r\n";
+static const int range_tail_len = sizeof(range_tail) - 1;
 
 
 //对文件描述符设置非阻塞
@@ -31,8 +32,14 @@ int setnonblocking(int fd)
 }
 
 //将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
+//epollfd为-1表示连接由io_uring驱动, 以下辅助函数都跳过epoll操作
 void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
 {
+    if (epollfd < 0)
+    {
+        setnonblocking(fd);
+        return;
+    }
     epoll_event event;
     event.data.fd = fd;
 
@@ -50,13 +57,16 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
 //从内核时间表删除描述符
 void removefd(int epollfd, int fd)
 {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
+    if (epollfd >= 0)
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
     close(fd);
 }
 
 //将事件重置为EPOLLONESHOT
 void modfd(int epollfd, int fd, int ev, int TRIGMode)
 {
+    if (epollfd < 0)
+        return;
     epoll_event event;
     event.data.fd = fd;
 
@@ -71,28 +81,39 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
 
 
 
-int http_conn::user_count_ = 0;
-int http_conn::epollfd_ = -1;
+std::atomic<int> http_conn::user_count_(0);
+bool http_conn::zero_copy_ = false;
+
+// 过载时的响应一次生成, 拒绝连接时只需一次send
+static const char busy_response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                    "Retry-After: 1\r\n"
+                                    "Content-Length: 0\r\n"
+                                    "Connection: close\r\n\r\n";
+
+void http_conn::send_busy(int sockfd) {
+    send(sockfd, busy_response, sizeof(busy_response) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
 
 
 
 
-void http_conn::init(int sockfd, const sockaddr_in &addr, char* root, int TRIGMode, int close_log, std::string user, std::string passwd, std::string sqlname) {
+void http_conn::init(int sockfd, const sockaddr_in &addr, config *cfg, int TRIGMode, int epollfd, int* loop_user_count) {
 
     sockfd_ = sockfd;
     address_ = addr;
-
-    addfd(epollfd_, sockfd, true, TRIGMode_);
-    user_count_++;
+    epollfd_ = epollfd;
+    loop_user_count_ = loop_user_count;
 
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
-    doc_root_ = root;
+    config_ = cfg;
     TRIGMode_ = TRIGMode;
-    close_log_ = close_log;
+    close_log_ = cfg->close_log;
+
+    addfd(epollfd_, sockfd, true, TRIGMode_);
+    user_count_++;
+    if (loop_user_count_)
+        ++*loop_user_count_;
 
-    sql_user_ = user;
-    sql_passwd_ = passwd;
-    sql_name_ = sqlname;
     init();
 }
 
@@ -101,32 +122,96 @@ void http_conn::close_conn(bool real_close) {
     if (real_close && (sockfd_ != -1))
     {
         LOG_INFO("close %d\n", sockfd_);
-        removefd(epollfd_, sockfd_);
+        unmap();
+        free_read_buffer();
+        free_write_buffer();
+        release_ctx();
+        int fd = sockfd_;
         sockfd_ = -1;
         --user_count_;
+        if (loop_user_count_)
+            --*loop_user_count_;
+        // 最后才关闭描述符: 多reactor模式下描述符一关闭就可能被其他事件循环accept复用并重新init这个对象
+        removefd(epollfd_, fd);
     }
 }
 
 
+void http_conn::request_close() {
+    shutdown(sockfd_, SHUT_RDWR);
+    modfd(epollfd_, sockfd_, EPOLLIN, TRIGMode_);
+}
+
+bool http_conn::needs_db() const {
+    return read_idx_ - req_start_ >= 4 && strncasecmp(read_buf_ + req_start_, "POST", 4) == 0;
+}
+
 void http_conn::process() {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST)
+    int ret = prepare_response();
+    // 重新注册事件后连接可能立即被交给另一个线程, 数据库连接由调用者归还, 这里先清空
+    mysql_ = nullptr;
+    if (ret == 0)
     {
         modfd(epollfd_, sockfd_, EPOLLIN, TRIGMode_);
         return;
     }
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)
+    if (ret < 0)
     {
-        close_conn();
+        request_close();
+        return;
     }
 
     modfd(epollfd_, sockfd_, EPOLLOUT, TRIGMode_);
 }
 
+// 解析已读入的数据并准备响应: 1响应已就绪, 0请求不完整需继续读, -1出错需关闭连接
+// 缓冲区中有多个完整的流水线请求时依次处理, 响应排在同一组iovec中一次写出
+int http_conn::prepare_response() {
+    if (!acquire_ctx())
+        return -1;
+    int responses = 0;
+    // 剩余的iovec和文件项要够一个多范围响应使用
+    // sendfile和分块响应都要在之后的写事件中继续发送, 必须是本批最后一个响应
+    while (responses < MAX_PIPELINE && send_fd_ == -1 && !ctx_->producer_ &&
+           iv_count_ <= 2 * MAX_PIPELINE && ctx_->file_count_ <= MAX_PIPELINE &&
+           (write_slab_count_ < MAX_WRITE_SLABS || WRITE_BUFFER_SIZE - write_idx_ >= PIPELINE_MARGIN))
+    {
+        HTTP_CODE read_ret = process_read();
+        if (read_ret == NO_REQUEST)
+            break;
+        if (!process_write(read_ret))
+            return -1;
+        ++responses;
+        keep_alive_ = linger_;
+        // 不保持连接时之后的请求不再处理
+        if (!linger_)
+            break;
+        reset_request();
+        // 没有数据库连接时遇到POST, 先发出已有的响应, 剩下的请求由调用者换到能取连接的地方处理
+        if (!mysql_ && needs_db())
+            break;
+    }
+    if (responses == 0)
+        return 0;
+    flush_segment();
+    return 1;
+}
+
+// 追加由外部(io_uring)收到的数据到读缓冲区, 返回实际追加的字节数, 读缓冲区到达上限时少于len
+int http_conn::append_read(const char *data, int len) {
+    long room = MAX_READ_BUFFER_SIZE - (read_idx_ - req_start_);
+    if (len > room)
+        len = room;
+    if (len <= 0 || !reserve_read(len))
+        return 0;
+    memcpy(read_buf_ + read_idx_, data, len);
+    read_idx_ += len;
+    return len;
+}
+
 
 bool http_conn::read_once() {
-    if (read_idx_ >= READ_BUFFER_SIZE)
+    if (!reserve_read())
     {
         return false;
     }
@@ -135,7 +220,7 @@ bool http_conn::read_once() {
     //LT读取数据
     if (0 == TRIGMode_)
     {
-        bytes_read = recv(sockfd_, read_buf_ + read_idx_, READ_BUFFER_SIZE - read_idx_, 0);
+        bytes_read = recv(sockfd_, read_buf_ + read_idx_, read_size_ - read_idx_, 0);
         read_idx_ += bytes_read;
 
         if (bytes_read <= 0)
@@ -148,9 +233,10 @@ bool http_conn::read_once() {
     //ET读数据
     else
     {
-        while (true)
+        // 缓冲区增长到上限时先处理已读入的请求, 重新注册事件后剩余数据会再次触发
+        do
         {
-            bytes_read = recv(sockfd_, read_buf_ + read_idx_, READ_BUFFER_SIZE - read_idx_, 0);
+            bytes_read = recv(sockfd_, read_buf_ + read_idx_, read_size_ - read_idx_, 0);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -162,7 +248,7 @@ bool http_conn::read_once() {
                 return false;
             }
             read_idx_ += bytes_read;
-        }
+        } while (reserve_read());
         return true;
     }
 }
@@ -178,9 +264,12 @@ bool http_conn::write() {
         return true;
     }
 
+    if (send_fd_ != -1)
+        return write_sendfile();
+
     while (1)
     {
-        temp = writev(sockfd_, iv_, iv_count_);
+        temp = writev(sockfd_, ctx_->iv_ + iv_idx_, iv_count_ - iv_idx_);
 
         if (temp < 0)
         {
@@ -193,43 +282,131 @@ bool http_conn::write() {
             return false;
         }
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        if (bytes_have_send >= iv_[0].iov_len)
+        if (advance_write(temp))
         {
-            iv_[0].iov_len = 0;
-            iv_[1].iov_base = file_address_ + (bytes_have_send - write_idx_);
-            iv_[1].iov_len = bytes_to_send;
-        }
-        else
-        {
-            iv_[0].iov_base = write_buf_ + bytes_have_send;
-            iv_[0].iov_len = iv_[0].iov_len - bytes_have_send;
+            if (!finish_write())
+                return false;
+            // 还有流水线请求时由调用者继续处理, 不注册读事件
+            if (!has_pending_input())
+                modfd(epollfd_, sockfd_, EPOLLIN, TRIGMode_);
+            return true;
         }
+    }
+}
 
-        if (bytes_to_send <= 0)
+// 零拷贝路径: 之前排队的响应和响应头带MSG_MORE发送, 与随后sendfile发出的文件数据合并成满段
+bool http_conn::write_sendfile() {
+    while (iv_idx_ < iv_count_)
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = ctx_->iv_ + iv_idx_;
+        msg.msg_iovlen = iv_count_ - iv_idx_;
+        int temp = sendmsg(sockfd_, &msg, MSG_MORE | MSG_NOSIGNAL);
+        if (temp < 0)
         {
-            unmap();
-            modfd(epollfd_, sockfd_, EPOLLIN, TRIGMode_);
-
-            if (linger_)
+            if (errno == EAGAIN)
             {
-                init();
+                modfd(epollfd_, sockfd_, EPOLLOUT, TRIGMode_);
                 return true;
             }
-            else
+            unmap();
+            return false;
+        }
+        advance_write(temp);
+    }
+
+    while (bytes_to_send > 0)
+    {
+        ssize_t temp = sendfile(sockfd_, send_fd_, &ctx_->file_offset_, bytes_to_send);
+        if (temp < 0)
+        {
+            if (errno == EAGAIN)
             {
-                return false;
+                modfd(epollfd_, sockfd_, EPOLLOUT, TRIGMode_);
+                return true;
             }
+            unmap();
+            return false;
         }
+        // 文件在发送过程中被截断
+        if (temp == 0)
+        {
+            unmap();
+            return false;
+        }
+        bytes_have_send += temp;
+        bytes_to_send -= temp;
     }
+
+    if (!finish_write())
+        return false;
+    if (!has_pending_input())
+        modfd(epollfd_, sockfd_, EPOLLIN, TRIGMode_);
+    return true;
+}
+
+// 已发送n字节, 跳过写完的iovec并调整第一个未写完的, 返回true表示响应全部发送完毕
+bool http_conn::advance_write(int n) {
+    bytes_have_send += n;
+    bytes_to_send -= n;
+    while (n > 0 && iv_idx_ < iv_count_)
+    {
+        struct iovec &iv = ctx_->iv_[iv_idx_];
+        if ((size_t)n >= iv.iov_len)
+        {
+            n -= iv.iov_len;
+            iv.iov_len = 0;
+            ++iv_idx_;
+        }
+        else
+        {
+            iv.iov_base = (char *)iv.iov_base + n;
+            iv.iov_len -= n;
+            n = 0;
+        }
+    }
+    if (bytes_to_send > 0)
+        return false;
+    // 分块响应: 已排队的数据发完后再向生成函数要下一块
+    if (ctx_->producer_)
+    {
+        iv_count_ = 0;
+        iv_idx_ = 0;
+        if (next_chunk())
+            return false;
+        // 生成函数出错, 响应没有最后一个分块, 关闭连接让客户端知道被截断
+        keep_alive_ = false;
+    }
+    return true;
+}
+
+// 响应发送完毕: 长连接保留未处理的流水线数据并重置状态, 返回true; 否则返回false由调用者关闭连接
+bool http_conn::finish_write() {
+    unmap();
+    free_write_buffer();
+    if (!keep_alive_)
+        return false;
+    compact_read();
+    // 没有未处理的数据, 连接进入空闲, 读缓冲区和请求状态也还给块池
+    if (read_idx_ == 0)
+    {
+        free_read_buffer();
+        release_ctx();
+    }
+    iv_count_ = 0;
+    iv_idx_ = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    return true;
 }
 
 
-void http_conn::initmysql_result(connection_pool *connPool) {
+void http_conn::initmysql_result(connection_pool *connPool, config *cfg) {
     //先从连接池中取一个连接
     MYSQL *mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
+    int close_log_ = cfg->close_log;    // 供LOG宏使用
 
     //在user表中检索username，passwd数据，浏览器端输入
     if (mysql_query(mysql, "SELECT username,passwd FROM user"))
@@ -251,33 +428,255 @@ void http_conn::initmysql_result(connection_pool *connPool) {
     {
         std::string temp1(row[0]);
         std::string temp2(row[1]);
-        users_[temp1] = temp2;
+        cfg->users[temp1] = temp2;
     }
 }
 
+// 把用户名转义后追加到out, 用户名由注册表单提交, 原样输出会被当成HTML
+static void escape_html(const std::string &in, std::string *out) {
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        switch (in[i])
+        {
+        case '&': *out += "&amp;"; break;
+        case '<': *out += "&lt;"; break;
+        case '>': *out += "&gt;"; break;
+        case '"': *out += "&quot;"; break;
+        case '\'': *out += "&#39;"; break;
+        default: *out += in[i];
+        }
+    }
+}
+
+// 用户列表页的生成函数: 每块从上一块最后一个用户名之后继续, 生成时才短暂加锁, 不复制整张用户表.
+// 用户表只增不减, 发送途中注册的用户排在游标之后时也会出现在页面上
+static http_conn::producer user_list(http_conn::config *cfg) {
+    static const char head[] = "<!DOCTYPE html>\n<html><head><meta charset=\"UTF-8\"><title>users</title></head>\n"
+                               "<body>\n<ul>\n";
+    static const char tail[] = "</ul>\n</body></html>\n";
+    std::string last;       // 已输出的最后一个用户名
+    bool started = false;   // 是否已输出过用户
+    int stage = 0;          // 0页头, 1用户, 2页尾, 3结束
+    return [cfg, last, started, stage](char *buf, int size) mutable -> int {
+        int n = 0;
+        if (stage == 0)
+        {
+            memcpy(buf, head, sizeof(head) - 1);
+            n = sizeof(head) - 1;
+            stage = 1;
+        }
+        if (stage == 1)
+        {
+            std::string row;
+            cfg->lock.lock();
+            std::map<std::string, std::string>::const_iterator it =
+                started ? cfg->users.upper_bound(last) : cfg->users.begin();
+            for (; it != cfg->users.end(); ++it)
+            {
+                row = "<li>";
+                escape_html(it->first, &row);
+                row += "</li>\n";
+                // 一行比整块还长时跳过这个用户, 否则生成函数会原地打转
+                if ((int)row.size() <= size)
+                {
+                    if (n + (int)row.size() > size)
+                        break;
+                    memcpy(buf + n, row.data(), row.size());
+                    n += row.size();
+                }
+                last = it->first;
+                started = true;
+            }
+            bool done = it == cfg->users.end();
+            cfg->lock.unlock();
+            if (!done)
+                return n;
+            stage = 2;
+        }
+        if (stage == 2)
+        {
+            if (n + (int)sizeof(tail) - 1 > size)
+                return n;
+            memcpy(buf + n, tail, sizeof(tail) - 1);
+            n += sizeof(tail) - 1;
+            stage = 3;
+        }
+        return n;
+    };
+}
+
+void http_conn::register_handlers(config *cfg) {
+    cfg->handlers["/users.html"] = [cfg](http_conn &) { return user_list(cfg); };
+}
+
 
 // 初始化新接收的连接， check_state_默认为分析请求行状态
 void http_conn::init() {
     mysql_ = nullptr;
     bytes_to_send = 0;
     bytes_have_send = 0;
+    checked_idx_ = 0;
+    read_idx_ = 0;
+    free_write_buffer();
+    iv_count_ = 0;
+    iv_idx_ = 0;
+    keep_alive_ = false;
+    state_ = 0;
+    timer_flag = 0;
+    improv = 0;
+    reset_request();
+}
+
+// 开始解析下一个请求, 它从上一个请求结束的位置开始
+void http_conn::reset_request() {
     check_state_ = CHECK_STATE_REQUEST_LINE;
     linger_ = false;
     method_ = GET;
     content_length_ = 0;
-    start_line_ = 0;
-    checked_idx_ = 0;
+    cgi_ = 0;
+    chunked_ = false;
+    url_ = nullptr;
+    version_ = nullptr;
+    start_line_ = checked_idx_;
+    req_start_ = checked_idx_;
+    if (ctx_)
+    {
+        ctx_->header_count_ = 0;
+        memset(ctx_->header_index_, -1, sizeof(ctx_->header_index_));
+        ctx_->range_count_ = 0;
+        ctx_->body_ = nullptr;
+        ctx_->body_len_ = 0;
+        if (ctx_->body_buf_)
+        {
+            buffer_pool::get_instance()->free(ctx_->body_buf_, ctx_->body_size_);
+            ctx_->body_buf_ = nullptr;
+            ctx_->body_size_ = 0;
+        }
+        ctx_->chunk_decoder_.reset();
+    }
+}
+
+// 开始处理请求前从块池取得请求状态, 网站根目录在这里拷贝一次, 每个请求只改写其后的页面路径
+bool http_conn::acquire_ctx() {
+    if (ctx_)
+        return true;
+    size_t size = sizeof(request_ctx);
+    char *block = buffer_pool::get_instance()->alloc(size);
+    if (!block)
+        return false;
+    ctx_ = new (block) request_ctx;
+    memset(ctx_->header_index_, -1, sizeof(ctx_->header_index_));
+    const std::string &root = config_->doc_root;
+    ctx_->doc_root_len_ = root.size() < (size_t)FILE_NAME_LEN / 2 ? root.size() : FILE_NAME_LEN / 2;
+    memcpy(ctx_->real_file_, root.data(), ctx_->doc_root_len_);
+    ctx_->real_file_len_ = ctx_->doc_root_len_;
+    ctx_->real_file_[ctx_->real_file_len_] = '\0';
+    return true;
+}
+
+// 连接空闲或关闭时归还请求状态, 调用前文件映射和写缓冲区已释放
+void http_conn::release_ctx() {
+    if (!ctx_)
+        return;
+    buffer_pool::get_instance()->free(ctx_->body_buf_, ctx_->body_size_);
+    buffer_pool::get_instance()->free(ctx_->chunk_buf_, CHUNK_BUFFER_SIZE);
+    ctx_->~request_ctx();
+    buffer_pool::get_instance()->free(reinterpret_cast<char *>(ctx_), sizeof(request_ctx));
+    ctx_ = nullptr;
+}
+
+// 把尚未处理完的请求挪到读缓冲区开头
+void http_conn::compact_read() {
+    if (req_start_ > 0)
+        relocate_read(read_buf_, req_start_);
+}
+
+// 保证读缓冲区至少有len字节空闲: 先尝试挪掉已处理的请求, 不够再换一块更大的, 超过上限返回false
+bool http_conn::reserve_read(long len) {
+    if (read_buf_ && read_size_ - read_idx_ >= len)
+        return true;
+    long used = read_idx_ - req_start_;
+    long size = READ_BUFFER_SIZE;
+    while (size < used + len)
+        size <<= 1;
+    if (size > MAX_READ_BUFFER_SIZE)
+        return false;
+    if (size <= read_size_)
+    {
+        relocate_read(read_buf_, req_start_);
+        return true;
+    }
+
+    size_t actual = size;
+    char *buf = buffer_pool::get_instance()->alloc(actual);
+    if (!buf)
+        return false;
+    char *old = read_buf_;
+    long old_size = read_size_;
+    if (old)
+        relocate_read(buf, req_start_);
+    read_buf_ = buf;
+    read_size_ = actual;
+    buffer_pool::get_instance()->free(old, old_size);
+    return true;
+}
+
+// 把读缓冲区中from开始的数据移到dst, 解析到一半的位置和指针一起平移
+void http_conn::relocate_read(char *dst, long from) {
+    char *src = read_buf_ + from;
+    long n = read_idx_ - from;
+    memmove(dst, src, n);
+    if (url_)
+        url_ = dst + (url_ - src);
+    if (version_)
+        version_ = dst + (version_ - src);
+    checked_idx_ -= from;
+    start_line_ -= from;
+    req_start_ -= from;
+    read_idx_ = n;
+    read_buf_ = dst;
+}
+
+void http_conn::free_read_buffer() {
+    buffer_pool::get_instance()->free(read_buf_, read_size_);
+    read_buf_ = nullptr;
+    read_size_ = 0;
     read_idx_ = 0;
+    checked_idx_ = 0;
+    start_line_ = 0;
+    req_start_ = 0;
+}
+
+// 当前写缓冲区块放不下时: 已写入的部分排入iovec, 从块池取下一块
+bool http_conn::next_write_slab() {
+    if (write_slab_count_ >= MAX_WRITE_SLABS)
+        return false;
+    flush_segment();
+    size_t size = WRITE_BUFFER_SIZE;
+    char *slab = buffer_pool::get_instance()->alloc(size);
+    if (!slab)
+        return false;
+    ctx_->write_slabs_[write_slab_count_++] = slab;
+    write_buf_ = slab;
     write_idx_ = 0;
-    cgi_ = 0;
-    state_ = 0;
-    timer_flag = 0;
-    improv = 0;
+    seg_start_ = 0;
+    return true;
+}
 
-    memset(read_buf_, '\0', READ_BUFFER_SIZE);
-    memset(write_buf_, '\0', WRITE_BUFFER_SIZE);
-    memset(real_file_, '\0', FILE_NAME_LEN);
-    
+void http_conn::free_write_buffer() {
+    for (int i = 0; i < write_slab_count_; ++i)
+        buffer_pool::get_instance()->free(ctx_->write_slabs_[i], WRITE_BUFFER_SIZE);
+    write_slab_count_ = 0;
+    if (ctx_)
+    {
+        // 连接在分块响应发送途中关闭时丢弃生成函数
+        ctx_->producer_ = nullptr;
+        buffer_pool::get_instance()->free(ctx_->chunk_buf_, CHUNK_BUFFER_SIZE);
+        ctx_->chunk_buf_ = nullptr;
+    }
+    write_buf_ = nullptr;
+    write_idx_ = 0;
+    seg_start_ = 0;
 }
 
 
@@ -290,7 +689,9 @@ http_conn::HTTP_CODE http_conn::process_read() {
     {
         text = get_line();
         start_line_ = checked_idx_;
-        LOG_INFO("%s", text);
+        // 请求体没有就地截断, 只记录请求行和请求头
+        if (check_state_ != CHECK_STATE_CONTENT)
+            LOG_INFO("%s", text);
         switch (check_state_)
         {
         case CHECK_STATE_REQUEST_LINE:
@@ -321,9 +722,11 @@ http_conn::HTTP_CODE http_conn::process_read() {
             ret = parse_content(text);
             if (ret==GET_REQUEST) {
                 return do_request();
+            } else if (ret==BAD_REQUEST) {
+                return BAD_REQUEST;
             }
-            line_status = LINE_OPEN;
-            break;
+            // 请求体不完整, 不能再按行扫描, 否则checked_idx_越过请求体起点
+            return NO_REQUEST;
             
         }
         default:
@@ -340,61 +743,184 @@ bool http_conn::process_write(HTTP_CODE ret) {
     switch (ret)
     {
     case INTERNAL_ERROR:
-    {
-        add_status_line(500, error_500_title);
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
-            return false;
-        break;
-    }
+        return add_canned(500);
     case BAD_REQUEST:
-    {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
-            return false;
-        break;
-    }
+        return add_canned(400);
+    case NO_RESOURCE:
+        return add_canned(404);
     case FORBIDDEN_REQUEST:
+        return add_canned(403);
+    case RANGE_NOT_SATISFIABLE:
+        return add_canned(416);
+    case NOT_MODIFIED:
+        // 304只有响应头
+        return add_status_line(304) && add_validators() && add_date() && add_linger() && add_blank_line();
+    case STREAM_REQUEST:
     {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        // 响应体长度事先未知, 用分块编码代替Content-Length
+        if (!(add_status_line(200) && add_content_type() && add_raw("Transfer-Encoding:chunked\r\n") &&
+              add_date() && add_linger() && add_blank_line()))
             return false;
-        break;
+        if (method_ == HEAD)
+        {
+            ctx_->producer_ = nullptr;
+            return true;
+        }
+        flush_segment();
+        return next_chunk();
     }
     case FILE_REQUEST:
     {
-        add_status_line(200, ok_200_title);
-        if (file_stat_.st_size != 0)
+        if (ctx_->file_stat_.st_size == 0)
+            return add_canned(200);
+        if (ctx_->range_count_ > 0)
+            return add_ranges();
+        // 缓存项带有预先生成的状态行、Content-Type、校验器和Content-Length
+        if (ctx_->cached_)
         {
-            add_headers(file_stat_.st_size);
-            iv_[0].iov_base = write_buf_;
-            iv_[0].iov_len = write_idx_;
-            iv_[1].iov_base = file_address_;
-            iv_[1].iov_len = file_stat_.st_size;
-            iv_count_ = 2;
-            bytes_to_send = write_idx_ + file_stat_.st_size;
+            if (!(add_raw(ctx_->cached_->header.data(), ctx_->cached_->header.size()) && add_date() && add_linger() && add_blank_line()))
+                return false;
+        }
+        else if (!(add_status_line(200) && add_raw("Accept-Ranges:bytes\r\n") && add_content_type() &&
+                   add_validators() && add_headers(ctx_->file_stat_.st_size)))
+            return false;
+        // HEAD请求只发响应头, do_request也没有打开或映射文件
+        if (method_ == HEAD)
             return true;
+        flush_segment();
+        if (ctx_->file_fd_ != -1)
+        {
+            // 零拷贝路径: 文件内容由sendfile发送, 它必须是本批最后一个响应
+            send_fd_ = ctx_->file_fd_;
+            ctx_->file_offset_ = 0;
+            bytes_to_send += ctx_->file_stat_.st_size;
         }
         else
         {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
-                return false;
+            push_iov(ctx_->file_address_, ctx_->file_stat_.st_size);
         }
+        hold_file();
+        return true;
     }
     default:
         return false;
     }
-    iv_[0].iov_base = write_buf_;
-    iv_[0].iov_len = write_idx_;
-    iv_count_ = 1;
-    bytes_to_send = write_idx_;
+}
+
+// 206响应: 单个范围直接带Content-Range, 多个范围按multipart/byteranges逐段排队, 每段数据是一个iovec
+bool http_conn::add_ranges() {
+    if (ctx_->range_count_ == 1)
+    {
+        byte_range &r = ctx_->ranges_[0];
+        if (!(add_status_line(206) && add_content_range(r.start, r.start + r.len - 1) && add_content_type() &&
+              add_validators() && add_headers(r.len)))
+            return false;
+        flush_segment();
+        if (ctx_->file_fd_ != -1)
+        {
+            send_fd_ = ctx_->file_fd_;
+            ctx_->file_offset_ = r.start;
+            bytes_to_send += r.len;
+        }
+        else
+        {
+            push_iov(r.addr, r.len);
+        }
+        hold_file();
+        return true;
+    }
+
+    // 先生成各段的分隔行, 算出整个响应体的长度
+    const http_response::text &type = http_response::mime_type(ctx_->real_file_, ctx_->real_file_len_);
+    char parts[MAX_RANGES][160];
+    int part_len[MAX_RANGES];
+    long total = range_tail_len;
+    for (int i = 0; i < ctx_->range_count_; ++i)
+    {
+        byte_range &r = ctx_->ranges_[i];
+        char *p = parts[i];
+        memcpy(p, range_part, range_part_len);
+        p += range_part_len;
+        memcpy(p, type.data, type.len);
+        p += type.len;
+        memcpy(p, "\r\nContent-Range:", 16);
+        p += 16;
+        p += http_response::format_content_range(p, r.start, r.start + r.len - 1, ctx_->file_stat_.st_size);
+        memcpy(p, "\r\n\r\n", 4);
+        part_len[i] = p + 4 - parts[i];
+        total += part_len[i] + r.len;
+    }
+    if (!(add_status_line(206) && add_raw(range_content_type, range_content_type_len) &&
+          add_validators() && add_headers(total)))
+        return false;
+    for (int i = 0; i < ctx_->range_count_; ++i)
+    {
+        if (!add_raw(parts[i], part_len[i]))
+            return false;
+        flush_segment();
+        push_iov(ctx_->ranges_[i].addr, ctx_->ranges_[i].len);
+    }
+    if (!add_raw(range_tail, range_tail_len))
+        return false;
+    hold_file();
     return true;
 }
 
+// 向生成函数要下一块数据, 在数据前后补上分块头和CRLF排入iovec; 生成函数结束时排入最后一个分块
+bool http_conn::next_chunk() {
+    if (!ctx_->chunk_buf_)
+    {
+        size_t size = CHUNK_BUFFER_SIZE;
+        ctx_->chunk_buf_ = buffer_pool::get_instance()->alloc(size);
+        if (!ctx_->chunk_buf_)
+        {
+            ctx_->producer_ = nullptr;
+            return false;
+        }
+    }
+    char *data = ctx_->chunk_buf_ + http_chunked::HEAD_ROOM;
+    int n = ctx_->producer_(data, CHUNK_BUFFER_SIZE - http_chunked::HEAD_ROOM - http_chunked::TAIL_ROOM);
+    if (n <= 0)
+    {
+        ctx_->producer_ = nullptr;
+        if (n < 0)
+            return false;
+        push_iov(const_cast<char *>(http_chunked::LAST_CHUNK), http_chunked::LAST_CHUNK_LEN);
+        return true;
+    }
+    int head_len = http_chunked::prepend_chunk_head(data, n);
+    data[n] = '\r';
+    data[n + 1] = '\n';
+    push_iov(data - head_len, head_len + n + 2);
+    return true;
+}
+
+void http_conn::push_iov(char *base, size_t len) {
+    ctx_->iv_[iv_count_].iov_base = base;
+    ctx_->iv_[iv_count_].iov_len = len;
+    ++iv_count_;
+    bytes_to_send += len;
+}
+
+// 把写缓冲区中新追加的数据作为一个iovec排队
+void http_conn::flush_segment() {
+    if (write_idx_ > seg_start_)
+    {
+        push_iov(write_buf_ + seg_start_, write_idx_ - seg_start_);
+        seg_start_ = write_idx_;
+    }
+}
+
+// 在网站根目录后拼接页面路径并以'\0'结尾, 超长时截断
+void http_conn::set_real_file(const char *page) {
+    size_t len = strlen(page);
+    if (len > (size_t)(FILE_NAME_LEN - 1 - ctx_->doc_root_len_))
+        len = FILE_NAME_LEN - 1 - ctx_->doc_root_len_;
+    memcpy(ctx_->real_file_ + ctx_->doc_root_len_, page, len);
+    ctx_->real_file_len_ = ctx_->doc_root_len_ + len;
+    ctx_->real_file_[ctx_->real_file_len_] = '\0';
+}
+
 // 解析http请求行，获得请求方法，目标url及http版本号
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     url_ = strpbrk(text, " \t");
@@ -406,6 +932,8 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     char *method = text;
     if (strcasecmp(method, "GET") == 0)
         method_ = GET;
+    else if (strcasecmp(method, "HEAD") == 0)
+        method_ = HEAD;
     else if (strcasecmp(method, "POST") == 0)
     {
         method_ = POST;
@@ -446,6 +974,18 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
     if (text[0] == '\0')
     {
+        if (chunked_)
+        {
+            // 同时带Content-Length时无法确定请求体边界, 拒绝以免与前面的代理理解不一致
+            if (content_length_ != 0)
+            {
+                linger_ = false;
+                return BAD_REQUEST;
+            }
+            ctx_->body_start_ = checked_idx_ - req_start_;
+            check_state_ = CHECK_STATE_CONTENT;
+            return NO_REQUEST;
+        }
         if (content_length_ != 0)
         {
             check_state_ = CHECK_STATE_CONTENT;
@@ -453,76 +993,214 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
         }
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    // 向量化查找':'分出请求头名, 再用完美哈希识别, 不再逐个strncasecmp
+    long name_len = http_scan::find_colon(text, line_len_);
+    if (name_len == line_len_)
+    {
+        return NO_REQUEST;
+    }
+    text[name_len] = '\0';
+    char *value = text + name_len + 1;
+    value += strspn(value, " \t");
+    long value_len = text + line_len_ - value;
+    while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t'))
+        value[--value_len] = '\0';
+
+    http_scan::HEADER_ID id = http_scan::lookup_header(text, name_len);
+    // 只记录偏移, 不拷贝; 同名请求头以第一个为准
+    if (ctx_->header_count_ < MAX_HEADERS)
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
+        char *base = read_buf_ + req_start_;
+        header_field &field = ctx_->headers_[ctx_->header_count_];
+        field.name_off = text - base;
+        field.name_len = name_len;
+        field.value_off = value - base;
+        field.value_len = value_len;
+        if (id != http_scan::HDR_UNKNOWN && ctx_->header_index_[id] < 0)
+            ctx_->header_index_[id] = ctx_->header_count_;
+        ++ctx_->header_count_;
+    }
+
+    switch (id)
+    {
+    case http_scan::HDR_CONNECTION:
+        if (strcasecmp(value, "keep-alive") == 0)
         {
             linger_ = true;
         }
+        break;
+    case http_scan::HDR_CONTENT_LENGTH:
+        // 负数、非数字或超过读缓冲区上限的长度会让解析位置越界, 直接拒绝
+        content_length_ = http_scan::parse_length(value, value_len, MAX_READ_BUFFER_SIZE);
+        if (content_length_ < 0)
+        {
+            content_length_ = 0;
+            linger_ = false;
+            return BAD_REQUEST;
+        }
+        break;
+    case http_scan::HDR_TRANSFER_ENCODING:
+        // 只支持chunked, 其他编码无法确定请求体边界
+        if (strcasecmp(value, "chunked") != 0)
+        {
+            linger_ = false;
+            return BAD_REQUEST;
+        }
+        chunked_ = true;
+        break;
+    default:
+        break;
     }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        content_length_ = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    return NO_REQUEST;
+}
+
+const char *http_conn::header_value(int i, size_t *len) const {
+    if (len)
+        *len = ctx_->headers_[i].value_len;
+    return read_buf_ + req_start_ + ctx_->headers_[i].value_off;
+}
+
+const char *http_conn::get_header(http_scan::HEADER_ID id, size_t *len) const {
+    if (!ctx_)
+        return nullptr;
+    int i = ctx_->header_index_[id];
+    return i < 0 ? nullptr : header_value(i, len);
+}
+
+const char *http_conn::get_header(const char *name, size_t *len) const {
+    http_scan::HEADER_ID id = http_scan::lookup_header(name, strlen(name));
+    if (id != http_scan::HDR_UNKNOWN)
+        return get_header(id, len);
+    for (int i = 0; i < header_count(); ++i)
     {
-        text += 5;
-        text += strspn(text, " \t");
-        host_ = text;
+        if (strcasecmp(header_name(i), name) == 0)
+            return header_value(i, len);
     }
-    else
+    return nullptr;
+}
+
+
+// 判断http请求体是否被完整读入
+http_conn::HTTP_CODE http_conn::parse_content(char *text) {
+    if (chunked_)
+        return parse_chunked();
+    if (content_length_ <= read_idx_ - checked_idx_)
     {
-        LOG_INFO("oop!unknow header: %s", text);
+        //POST请求中最后为输入的用户名和密码, 请求体之后可能紧跟下一个流水线请求, 不能就地截断, 只记录位置
+        ctx_->body_ = text;
+        ctx_->body_len_ = content_length_;
+        checked_idx_ += content_length_;
+        return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
+// 分块请求体: 解码已读入的部分追加到块池缓冲区, 已解码的数据从读缓冲区移除,
+// 读缓冲区只保留请求头和未解码的尾部, 请求体大小不受读缓冲区上限限制
+http_conn::HTTP_CODE http_conn::parse_chunked() {
+    for (;;)
+    {
+        long used = 0, produced = 0;
+        http_chunked::STATUS status = ctx_->chunk_decoder_.decode(read_buf_ + checked_idx_, read_idx_ - checked_idx_, &used,
+                                                                   ctx_->body_buf_ + ctx_->body_len_,
+                                                                   ctx_->body_size_ - ctx_->body_len_, &produced);
+        checked_idx_ += used;
+        ctx_->body_len_ += produced;
+        if (status == http_chunked::CHUNK_BAD)
+        {
+            linger_ = false;
+            return BAD_REQUEST;
+        }
+        if (status == http_chunked::CHUNK_DONE)
+            break;
+        // 解码缓冲区写满, 换一块更大的继续
+        if (checked_idx_ < read_idx_)
+        {
+            if (!grow_body())
+            {
+                linger_ = false;
+                return BAD_REQUEST;
+            }
+            continue;
+        }
+        // 读入的数据都已解码, 下次从请求体起点继续读
+        read_idx_ = checked_idx_ = start_line_ = req_start_ + ctx_->body_start_;
+        return NO_REQUEST;
+    }
+    ctx_->body_ = ctx_->body_buf_;
+    start_line_ = checked_idx_;
+    return GET_REQUEST;
+}
 
-http_conn::HTTP_CODE http_conn::parse_content(char *text) {
+// 解码缓冲区按2的幂增长, 超过MAX_BODY_SIZE返回false
+bool http_conn::grow_body() {
+    size_t size = ctx_->body_size_ ? ctx_->body_size_ * 2 : READ_BUFFER_SIZE;
+    if (size > (size_t)MAX_BODY_SIZE)
+        return false;
+    char *buf = buffer_pool::get_instance()->alloc(size);
+    if (!buf)
+        return false;
+    memcpy(buf, ctx_->body_buf_, ctx_->body_len_);
+    buffer_pool::get_instance()->free(ctx_->body_buf_, ctx_->body_size_);
+    ctx_->body_buf_ = buf;
+    ctx_->body_size_ = size;
+    return true;
+}
 
+const char *http_conn::body(long *len) const {
+    if (!ctx_ || !ctx_->body_)
+    {
+        *len = 0;
+        return nullptr;
+    }
+    *len = ctx_->body_len_;
+    return ctx_->body_;
 }
 
 http_conn::HTTP_CODE http_conn::do_request() {
-    strcpy(real_file_, doc_root_.c_str());
-    int len = doc_root_.size();
-    //printf("url:%s\n", url);
+    // 注册了处理函数的URL生成动态响应, 以分块编码边生成边发送
+    if (!config_->handlers.empty())
+    {
+        std::map<std::string, handler>::const_iterator it = config_->handlers.find(url_);
+        if (it != config_->handlers.end())
+        {
+            set_real_file(url_);
+            ctx_->producer_ = it->second(*this);
+            return ctx_->producer_ ? STREAM_REQUEST : INTERNAL_ERROR;
+        }
+    }
+
     const char *p = strrchr(url_, '/');
 
     //处理cgi
     if (cgi_ == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
     {
 
-        //根据标志判断是登录检测还是注册检测
-        char flag = url_[1];
-
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/");
-        strcat(url_real, url_ + 2);
-        strncpy(real_file_ + len, url_real, FILE_NAME_LEN - len - 1);
-        free(url_real);
-
+        // 校验结果改写url_, 目标文件在下面统一拼接
         //将用户名和密码提取出来
         //user=123&passwd=123
+        //请求体不再受读缓冲区大小限制, 超长的用户名和密码截断到数组大小
         char name[100], password[100];
-        int i;
-        for (i = 5; string_[i] != '&'; ++i)
-            name[i - 5] = string_[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; string_[i] != '\0'; ++i, ++j)
-            password[j] = string_[i];
+        const char *body = ctx_->body_;
+        long body_len = ctx_->body_len_;
+        long i, j = 0;
+        for (i = 5; i < body_len && body[i] != '&'; ++i)
+            if (j < (long)sizeof(name) - 1)
+                name[j++] = body[i];
+        name[j] = '\0';
+
+        j = 0;
+        for (i = i + 10; i < body_len; ++i)
+            if (j < (long)sizeof(password) - 1)
+                password[j++] = body[i];
         password[j] = '\0';
 
         if (*(p + 1) == '3')
         {
             //如果是注册，先检测数据库中是否有重名的
             //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
+            char *sql_insert = (char *)malloc(sizeof(char) * 256);
             strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
             strcat(sql_insert, "'");
             strcat(sql_insert, name);
@@ -530,26 +1208,35 @@ http_conn::HTTP_CODE http_conn::do_request() {
             strcat(sql_insert, password);
             strcat(sql_insert, "')");
 
-            if (users_.find(name) == users_.end())
+            // 用户表由全部连接共享, 查重和插入在同一次加锁内完成
+            config_->lock.lock();
+            if (config_->users.find(name) == config_->users.end())
             {
-                lock_.lock();
                 int res = mysql_query(mysql_, sql_insert);
-                users_.insert(std::pair<std::string, std::string>(name, password));
-                lock_.unlock();
-
+                if (!res)
+                    config_->users.insert(std::pair<std::string, std::string>(name, password));
+                config_->lock.unlock();
                 if (!res)
                     strcpy(url_, "/log.html");
                 else
                     strcpy(url_, "/registerError.html");
             }
             else
+            {
+                config_->lock.unlock();
                 strcpy(url_, "/registerError.html");
+            }
+            free(sql_insert);
         }
         //如果是登录，直接判断
         //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
         else if (*(p + 1) == '2')
         {
-            if (users_.find(name) != users_.end() && users_[name] == password)
+            config_->lock.lock();
+            std::map<std::string, std::string>::const_iterator it = config_->users.find(name);
+            bool ok = it != config_->users.end() && it->second == password;
+            config_->lock.unlock();
+            if (ok)
                 strcpy(url_, "/welcome.html");
             else
                 strcpy(url_, "/logError.html");
@@ -557,145 +1244,404 @@ http_conn::HTTP_CODE http_conn::do_request() {
     }
 
     if (*(p + 1) == '0')
-    {
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/register.html");
-        strncpy(real_file_ + len, url_real, strlen(url_real));
-
-        free(url_real);
-    }
+        set_real_file("/register.html");
     else if (*(p + 1) == '1')
-    {
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/log.html");
-        strncpy(real_file_ + len, url_real, strlen(url_real));
-
-        free(url_real);
-    }
+        set_real_file("/log.html");
     else if (*(p + 1) == '5')
-    {
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/picture.html");
-        strncpy(real_file_ + len, url_real, strlen(url_real));
-
-        free(url_real);
-    }
+        set_real_file("/picture.html");
     else if (*(p + 1) == '6')
-    {
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/video.html");
-        strncpy(real_file_ + len, url_real, strlen(url_real));
-
-        free(url_real);
-    }
+        set_real_file("/video.html");
     else if (*(p + 1) == '7')
-    {
-        char *url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(url_real, "/fans.html");
-        strncpy(real_file_ + len, url_real, strlen(url_real));
+        set_real_file("/fans.html");
+    else
+        set_real_file(url_);
 
-        free(url_real);
+    // 命中共享文件缓存时直接复用其stat结果、映射和描述符, 不再访问文件系统
+    ctx_->cached_ = file_cache::get_instance()->get(ctx_->real_file_);
+    if (ctx_->cached_)
+    {
+        ctx_->file_stat_ = ctx_->cached_->st;
+        memcpy(ctx_->etag_, ctx_->cached_->etag.c_str(), ctx_->cached_->etag.size() + 1);
+        memcpy(ctx_->last_modified_, ctx_->cached_->last_modified.c_str(), ctx_->cached_->last_modified.size() + 1);
+        HTTP_CODE ret = check_preconditions();
+        // 只有真正发送内容时才引用缓存项的映射和描述符
+        if (ret != FILE_REQUEST || method_ == HEAD)
+            return ret;
+        ctx_->file_address_ = ctx_->cached_->addr;
+        for (int i = 0; i < ctx_->range_count_; ++i)
+            ctx_->ranges_[i].addr = ctx_->file_address_ + ctx_->ranges_[i].start;
+        // 多范围响应各段之间夹着分隔行, 只能走映射
+        if (zero_copy_ && ctx_->file_stat_.st_size != 0 && ctx_->range_count_ <= 1)
+            ctx_->file_fd_ = ctx_->cached_->fd;
+        return FILE_REQUEST;
     }
-    else
-        strncpy(real_file_ + len, url_, FILE_NAME_LEN - len - 1);
 
-    if (stat(real_file_, &file_stat_) < 0)
+    if (stat(ctx_->real_file_, &ctx_->file_stat_) < 0)
         return NO_RESOURCE;
 
-    if (!(file_stat_.st_mode & S_IROTH))
+    if (!(ctx_->file_stat_.st_mode & S_IROTH))
         return FORBIDDEN_REQUEST;
 
-    if (S_ISDIR(file_stat_.st_mode))
+    if (S_ISDIR(ctx_->file_stat_.st_mode))
         return BAD_REQUEST;
 
-    int fd = open(real_file_, O_RDONLY);
-    file_address_ = (char *)mmap(0, file_stat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 一秒内刚修改过的文件可能在同一秒内再次修改, 只给弱校验器
+    file_cache::format_etag(ctx_->file_stat_, ctx_->file_stat_.st_mtime >= time(nullptr) - 1, ctx_->etag_, sizeof(ctx_->etag_));
+    http_response::format_http_date(ctx_->file_stat_.st_mtime, ctx_->last_modified_, sizeof(ctx_->last_modified_));
+    HTTP_CODE ret = check_preconditions();
+    if (ret != FILE_REQUEST)
+        return ret;
+
+    if (ctx_->file_stat_.st_size == 0 || method_ == HEAD)
+        return FILE_REQUEST;
+
+    int fd = open(ctx_->real_file_, O_RDONLY);
+    if (fd < 0)
+        return NO_RESOURCE;
+    // 零拷贝模式保留文件描述符, 发送时用sendfile, 不建立映射
+    if (zero_copy_ && ctx_->range_count_ <= 1)
+    {
+        ctx_->file_fd_ = fd;
+        return FILE_REQUEST;
+    }
+    // Range请求只映射请求的范围, 大文件的拖动播放不再映射整个文件
+    if (ctx_->range_count_ > 0)
+    {
+        for (int i = 0; i < ctx_->range_count_; ++i)
+        {
+            ctx_->ranges_[i].addr = map_window(fd, ctx_->ranges_[i].start, ctx_->ranges_[i].len);
+            if (!ctx_->ranges_[i].addr)
+            {
+                close(fd);
+                return INTERNAL_ERROR;
+            }
+        }
+        close(fd);
+        return FILE_REQUEST;
+    }
+    ctx_->file_address_ = (char *)mmap(0, ctx_->file_stat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     close(fd);
+    if (ctx_->file_address_ == MAP_FAILED)
+    {
+        ctx_->file_address_ = 0;
+        return INTERNAL_ERROR;
+    }
     return FILE_REQUEST;
 }
 
-//从状态机，用于分析出一行内容
-//返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
-http_conn::LINE_STATUS http_conn::parse_line() {
-    char temp;
-    for (; checked_idx_ < read_idx_; ++checked_idx_)
+// 条件请求: If-None-Match优先于If-Modified-Since, 满足时返回304; If-Range不匹配时忽略Range返回整个文件
+http_conn::HTTP_CODE http_conn::check_preconditions() {
+    if (method_ != GET && method_ != HEAD)
+        return FILE_REQUEST;
+    const char *inm = get_header(http_scan::HDR_IF_NONE_MATCH);
+    if (inm)
     {
-        temp = read_buf_[checked_idx_];
-        if (temp == '\r')
+        if (etag_matches(inm))
+            return NOT_MODIFIED;
+    }
+    else
+    {
+        const char *ims = get_header(http_scan::HDR_IF_MODIFIED_SINCE);
+        if (ims)
+        {
+            time_t since = http_response::parse_http_date(ims);
+            if (since != -1 && ctx_->file_stat_.st_mtime <= since)
+                return NOT_MODIFIED;
+        }
+    }
+
+    const char *if_range = get_header(http_scan::HDR_IF_RANGE);
+    if (if_range)
+    {
+        // If-Range要求强比较, 日期必须与Last-Modified完全相同
+        bool match = if_range[0] == '"' ? strcmp(if_range, ctx_->etag_) == 0 : strcmp(if_range, ctx_->last_modified_) == 0;
+        if (!match)
+        {
+            ctx_->range_count_ = 0;
+            return FILE_REQUEST;
+        }
+    }
+    return parse_range();
+}
+
+// If-None-Match使用弱比较: 忽略W/前缀比较引号内的值, "*"匹配任何存在的文件
+bool http_conn::etag_matches(const char *list) const {
+    const char *mine = ctx_->etag_[0] == 'W' ? ctx_->etag_ + 2 : ctx_->etag_;
+    size_t mine_len = strlen(mine);
+    const char *p = list;
+    while (*p)
+    {
+        p += strspn(p, " \t,");
+        if (*p == '*')
+            return true;
+        if (p[0] == 'W' && p[1] == '/')
+            p += 2;
+        size_t len = strcspn(p, ",");
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            --len;
+        if (len == mine_len && memcmp(p, mine, len) == 0)
+            return true;
+        p += strcspn(p, ",");
+    }
+    return false;
+}
+
+// 解析Range: bytes=a-b,c-,-n. 语法错误、范围过多或不是GET时忽略Range返回整个文件;
+// 没有一个范围落在文件内时返回416. 开放式范围最多返回RANGE_WINDOW字节, 客户端会接着请求后面的部分
+http_conn::HTTP_CODE http_conn::parse_range() {
+    ctx_->range_count_ = 0;
+    const char *p = get_header(http_scan::HDR_RANGE);
+    if (!p || method_ != GET || ctx_->file_stat_.st_size == 0 || strncasecmp(p, "bytes=", 6) != 0)
+        return FILE_REQUEST;
+    p += 6;
+
+    off_t size = ctx_->file_stat_.st_size;
+    int count = 0;
+    bool satisfiable = false;
+    while (true)
+    {
+        p += strspn(p, " \t");
+        off_t start, end;
+        char *next;
+        if (*p == '-')
+        {
+            // 后缀范围: 最后n字节
+            long long n = strtoll(p + 1, &next, 10);
+            if (next == p + 1 || n < 0)
+                return FILE_REQUEST;
+            start = n >= size ? 0 : size - n;
+            end = n == 0 ? -1 : size - 1;
+        }
+        else
         {
-            if ((checked_idx_ + 1) == read_idx_)
-                return LINE_OPEN;
-            else if (read_buf_[checked_idx_ + 1] == '\n')
+            if (*p < '0' || *p > '9')
+                return FILE_REQUEST;
+            start = strtoll(p, &next, 10);
+            if (*next != '-')
+                return FILE_REQUEST;
+            p = next + 1;
+            if (*p >= '0' && *p <= '9')
+            {
+                end = strtoll(p, &next, 10);
+                if (end < start)
+                    return FILE_REQUEST;
+                if (end >= size)
+                    end = size - 1;
+            }
+            else
             {
-                read_buf_[checked_idx_++] = '\0';
-                read_buf_[checked_idx_++] = '\0';
-                return LINE_OK;
+                next = (char *)p;
+                end = start + RANGE_WINDOW - 1 < size - 1 ? start + RANGE_WINDOW - 1 : size - 1;
             }
-            return LINE_BAD;
         }
-        else if (temp == '\n')
+        // 起点超出文件的范围不可满足, 跳过
+        if (start < size && end >= start)
         {
-            if (checked_idx_ > 1 && read_buf_[checked_idx_ - 1] == '\r')
+            if (count == MAX_RANGES)
             {
-                read_buf_[checked_idx_ - 1] = '\0';
-                read_buf_[checked_idx_++] = '\0';
-                return LINE_OK;
+                ctx_->range_count_ = 0;
+                return FILE_REQUEST;
             }
-            return LINE_BAD;
+            ctx_->ranges_[count].start = start;
+            ctx_->ranges_[count].len = end - start + 1;
+            ctx_->ranges_[count].addr = nullptr;
+            ++count;
+            satisfiable = true;
         }
+        p = next + strspn(next, " \t");
+        if (*p == '\0')
+            break;
+        if (*p != ',')
+            return FILE_REQUEST;
+        ++p;
     }
-    return LINE_OPEN;   
+    if (!satisfiable)
+        return RANGE_NOT_SATISFIABLE;
+    ctx_->range_count_ = count;
+    return FILE_REQUEST;
 }
-void http_conn::unmap() {
-    if (file_address_)
+
+// 按页对齐映射文件的一个范围, 映射直接交给排队的响应持有, 返回范围起点在映射中的地址
+char *http_conn::map_window(int fd, off_t start, off_t len) {
+    static const off_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    off_t base = start & ~page_mask;
+    size_t map_len = len + (start - base);
+    char *addr = (char *)mmap(0, map_len, PROT_READ, MAP_PRIVATE, fd, base);
+    if (addr == MAP_FAILED)
+        return nullptr;
+    file_ref &ref = ctx_->files_[ctx_->file_count_++];
+    ref.addr = addr;
+    ref.len = map_len;
+    ref.fd = -1;
+    ref.cached.reset();
+    return addr + (start - base);
+}
+
+//从状态机，用于分析出一行内容
+//返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
+http_conn::LINE_STATUS http_conn::parse_line() {
+    // 一次比较16/32字节, 直接跳到下一个'\r'或'\n'
+    checked_idx_ += http_scan::find_eol(read_buf_ + checked_idx_, read_idx_ - checked_idx_);
+    if (checked_idx_ >= read_idx_)
+        return LINE_OPEN;
+    line_len_ = checked_idx_ - start_line_;
+    if (read_buf_[checked_idx_] == '\r')
     {
-        munmap(file_address_, file_stat_.st_size);
-        file_address_ = 0;
+        if ((checked_idx_ + 1) == read_idx_)
+            return LINE_OPEN;
+        else if (read_buf_[checked_idx_ + 1] == '\n')
+        {
+            read_buf_[checked_idx_++] = '\0';
+            read_buf_[checked_idx_++] = '\0';
+            return LINE_OK;
+        }
+        return LINE_BAD;
     }
+    if (checked_idx_ > 1 && read_buf_[checked_idx_ - 1] == '\r')
+    {
+        read_buf_[checked_idx_ - 1] = '\0';
+        read_buf_[checked_idx_++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
+}
+// 当前请求的文件交给排队的响应持有
+void http_conn::hold_file() {
+    // 只映射了范围窗口时窗口已由map_window交给排队的响应
+    if (!ctx_->file_address_ && ctx_->file_fd_ == -1 && !ctx_->cached_)
+        return;
+    file_ref &ref = ctx_->files_[ctx_->file_count_++];
+    ref.addr = ctx_->file_address_;
+    ref.len = ctx_->file_stat_.st_size;
+    ref.fd = ctx_->file_fd_;
+    ref.cached.swap(ctx_->cached_);
+    ctx_->file_address_ = 0;
+    ctx_->file_fd_ = -1;
 }
 
-bool http_conn::add_response(const char *format, ...) {
-    if (write_idx_, WRITE_BUFFER_SIZE)
+// 释放已排队响应和当前请求的文件映射或零拷贝路径打开的文件
+void http_conn::unmap() {
+    send_fd_ = -1;
+    if (!ctx_)
+        return;
+    for (int i = 0; i < ctx_->file_count_; ++i)
     {
-        return false;
+        file_ref &ref = ctx_->files_[i];
+        // 缓存项只释放引用, 被淘汰后由最后一个持有者解除映射
+        if (ref.cached)
+            ref.cached.reset();
+        else
+        {
+            if (ref.addr)
+                munmap(ref.addr, ref.len);
+            if (ref.fd != -1)
+                close(ref.fd);
+        }
     }
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = std::vsnprintf(write_buf_+write_idx_, WRITE_BUFFER_SIZE-write_idx_, format, arg_list);
-    if (len>=WRITE_BUFFER_SIZE-1-write_idx_)
+    ctx_->file_count_ = 0;
+
+    if (ctx_->cached_)
     {
-        va_end(arg_list);
-        return false;
+        ctx_->cached_.reset();
+        ctx_->file_address_ = 0;
+        ctx_->file_fd_ = -1;
+        return;
+    }
+    if (ctx_->file_address_)
+    {
+        munmap(ctx_->file_address_, ctx_->file_stat_.st_size);
+        ctx_->file_address_ = 0;
+    }
+    if (ctx_->file_fd_ != -1)
+    {
+        close(ctx_->file_fd_);
+        ctx_->file_fd_ = -1;
+    }
+}
+
+// 响应头由预先生成的片段拼接, 当前块放不下时换一块, 一次追加的内容不能超过一整块
+bool http_conn::add_raw(const char *data, int len) {
+    if (!write_buf_ || len > WRITE_BUFFER_SIZE - write_idx_)
+    {
+        if (len > WRITE_BUFFER_SIZE || !next_write_slab())
+            return false;
     }
+    memcpy(write_buf_ + write_idx_, data, len);
     write_idx_ += len;
-    va_end(arg_list);
-    LOG_INFO("request: %s", write_buf_);
     return true;
 }
 
-bool http_conn::add_content(const char *content) {
-    return add_response("%s", content);
+// 固定内容的响应, 416还要带上文件大小
+bool http_conn::add_canned(int status) {
+    const http_response::canned &r = http_response::canned_response(status);
+    return add_raw(r.head.data, r.head.len) && (status != 416 || add_content_range(-1, -1)) &&
+           add_date() && add_linger() && add_blank_line() && add_content(r.body.data, r.body.len);
+}
+
+bool http_conn::add_content(const char *content, int len) {
+    // HEAD请求的响应没有响应体, Content-Length仍按GET计算
+    if (method_ == HEAD)
+        return true;
+    return add_raw(content, len);
 }
 
-bool http_conn::add_status_line(int status, const char *title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+bool http_conn::add_status_line(int status) {
+    const http_response::text &line = http_response::status_line(status);
+    return add_raw(line.data, line.len);
 }
 
-bool http_conn::add_headers(int content_length) {
-    return add_content_length(content_length) && add_linger() && add_blank_line();
+bool http_conn::add_headers(long content_length) {
+    return add_content_length(content_length) && add_date() && add_linger() && add_blank_line();
 }
 
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    const http_response::text &type = http_response::mime_type(ctx_->real_file_, ctx_->real_file_len_);
+    return add_raw("Content-Type:") && add_raw(type.data, type.len) && add_raw("\r\n");
+}
+
+bool http_conn::add_content_length(long content_length) {
+    char buf[40];
+    memcpy(buf, "Content-Length:", 15);
+    int len = 15 + http_response::itoa(content_length, buf + 15);
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    return add_raw(buf, len);
+}
+
+// start为负时表示不可满足的范围: bytes */size
+bool http_conn::add_content_range(off_t start, off_t end) {
+    char buf[96];
+    memcpy(buf, "Content-Range:", 14);
+    int len = 14;
+    if (start < 0)
+    {
+        memcpy(buf + len, "bytes */", 8);
+        len += 8;
+        len += http_response::itoa(ctx_->file_stat_.st_size, buf + len);
+    }
+    else
+        len += http_response::format_content_range(buf + len, start, end, ctx_->file_stat_.st_size);
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    return add_raw(buf, len);
 }
 
-bool http_conn::add_content_length(int content_length) {
-    return add_response("Content-Length:%d\r\n", content_length);
+bool http_conn::add_date() {
+    const http_response::text &date = http_response::date_header();
+    return add_raw(date.data, date.len);
 }
+
 bool http_conn::add_linger() {
-    return add_response("Connection:%s\r\n", linger_ ? "keep-alive" : "close");
+    if (linger_)
+        return add_raw("Connection:keep-alive\r\n");
+    return add_raw("Connection:close\r\n");
+}
+
+bool http_conn::add_validators() {
+    return add_raw("ETag:") && add_raw(ctx_->etag_, strlen(ctx_->etag_)) &&
+           add_raw("\r\nLast-Modified:") && add_raw(ctx_->last_modified_, strlen(ctx_->last_modified_)) && add_raw("\r\n");
 }
 
 bool http_conn::add_blank_line() {
-    return add_response("%s", "\r\n");
-}
\ No newline at end of file
+    return add_raw("\r\n");
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "http_response.hpp"
+
+#define TEXT(s) { s, sizeof(s) - 1 }
+
+static const http_response::text status_200 = TEXT("HTTP/1.1 200 OK\r\n");
+static const http_response::text status_206 = TEXT("HTTP/1.1 206 Partial Content\r\n");
+static const http_response::text status_304 = TEXT("HTTP/1.1 304 Not Modified\r\n");
+static const http_response::text status_400 = TEXT("HTTP/1.1 400 Bad Request\r\n");
+static const http_response::text status_403 = TEXT("HTTP/1.1 403 Forbidden\r\n");
+static const http_response::text status_404 = TEXT("HTTP/1.1 404 Not Found\r\n");
+static const http_response::text status_416 = TEXT("HTTP/1.1 416 Range Not Satisfiable\r\n");
+static const http_response::text status_500 = TEXT("HTTP/1.1 500 Internal Error\r\n");
+
+const http_response::text& http_response::status_line(int status) {
+    switch (status) {
+    case 200: return status_200;
+    case 206: return status_206;
+    case 304: return status_304;
+    case 400: return status_400;
+    case 403: return status_403;
+    case 404: return status_404;
+    case 416: return status_416;
+    default: return status_500;
+    }
+}
+
+// 固定响应的响应体, 响应头在静态初始化时按长度生成一次
+static const int CANNED_NUM = 6;
+static const int canned_status[CANNED_NUM] = {200, 400, 403, 404, 416, 500};
+static const http_response::text canned_body[CANNED_NUM] = {
+    TEXT("<html><body></body></html>"),
+    TEXT("Your request has bad syntax or is inherently impossible to staisfy.\n"),
+    TEXT("You do not have permission to get file form this server.\n"),
+    TEXT("The requested file was not found on this server.\n"),
+    TEXT("The requested range is not satisfiable.\n"),
+    TEXT("There was an unusual problem serving the request file.\n"),
+};
+static char canned_head_buf[CANNED_NUM][128];
+static http_response::canned canned_table[CANNED_NUM];
+
+static bool build_canned() {
+    for (int i = 0; i < CANNED_NUM; ++i) {
+        const http_response::text& line = http_response::status_line(canned_status[i]);
+        int len = snprintf(canned_head_buf[i], sizeof(canned_head_buf[i]), "%sContent-Type:text/html\r\nContent-Length:%d\r\n",
+                           line.data, canned_body[i].len);
+        canned_table[i].head.data = canned_head_buf[i];
+        canned_table[i].head.len = len;
+        canned_table[i].body = canned_body[i];
+    }
+    return true;
+}
+
+static bool canned_built = build_canned();
+
+const http_response::canned& http_response::canned_response(int status) {
+    for (int i = 0; i < CANNED_NUM; ++i) {
+        if (canned_status[i] == status) {
+            return canned_table[i];
+        }
+    }
+    return canned_table[CANNED_NUM - 1];
+}
+
+const http_response::text& http_response::date_header() {
+    static thread_local time_t last = 0;
+    static thread_local char buf[48];
+    static thread_local text header = { buf, 0 };
+    time_t now = time(nullptr);
+    if (now != last) {
+        last = now;
+        memcpy(buf, "Date:", 5);
+        int len = 5 + format_http_date(now, buf + 5, sizeof(buf) - 7);
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+        header.len = len;
+    }
+    return header;
+}
+
+int http_response::itoa(unsigned long long v, char* buf) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    for (int i = 0; i < n; ++i) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+int http_response::format_content_range(char* buf, long long start, long long end, long long size) {
+    memcpy(buf, "bytes ", 6);
+    int len = 6;
+    len += itoa(start, buf + len);
+    buf[len++] = '-';
+    len += itoa(end, buf + len);
+    buf[len++] = '/';
+    len += itoa(size, buf + len);
+    return len;
+}
+
+// 完美哈希: 长度、首字符、中间字符和末字符(忽略大小写)组合后对64取模, 下表中的扩展名两两不冲突
+static const int MIME_TABLE_SIZE = 64;
+
+static inline unsigned mime_hash(const char* ext, size_t len) {
+    return (len + (ext[0] | 0x20) + (ext[len - 1] | 0x20) * 22 + (ext[len / 2] | 0x20) * 24) & (MIME_TABLE_SIZE - 1);
+}
+
+struct mime_entry {
+    const char* ext;
+    http_response::text type;
+};
+
+static const mime_entry mime_entries[] = {
+    { "html", TEXT("text/html") },
+    { "htm", TEXT("text/html") },
+    { "css", TEXT("text/css") },
+    { "js", TEXT("application/javascript") },
+    { "mjs", TEXT("application/javascript") },
+    { "json", TEXT("application/json") },
+    { "txt", TEXT("text/plain") },
+    { "xml", TEXT("application/xml") },
+    { "png", TEXT("image/png") },
+    { "jpg", TEXT("image/jpeg") },
+    { "jpeg", TEXT("image/jpeg") },
+    { "gif", TEXT("image/gif") },
+    { "ico", TEXT("image/x-icon") },
+    { "svg", TEXT("image/svg+xml") },
+    { "webp", TEXT("image/webp") },
+    { "bmp", TEXT("image/bmp") },
+    { "mp4", TEXT("video/mp4") },
+    { "webm", TEXT("video/webm") },
+    { "avi", TEXT("video/x-msvideo") },
+    { "mp3", TEXT("audio/mpeg") },
+    { "ogg", TEXT("audio/ogg") },
+    { "wav", TEXT("audio/wav") },
+    { "pdf", TEXT("application/pdf") },
+    { "zip", TEXT("application/zip") },
+    { "gz", TEXT("application/gzip") },
+    { "woff", TEXT("font/woff") },
+    { "woff2", TEXT("font/woff2") },
+    { "ttf", TEXT("font/ttf") },
+    { "wasm", TEXT("application/wasm") },
+};
+
+static const http_response::text mime_default = TEXT("application/octet-stream");
+
+// 哈希槽 -> mime_entries下标+1, 0表示空槽
+static unsigned char mime_table[MIME_TABLE_SIZE];
+
+static bool build_mime_table() {
+    for (size_t i = 0; i < sizeof(mime_entries) / sizeof(mime_entries[0]); ++i) {
+        mime_table[mime_hash(mime_entries[i].ext, strlen(mime_entries[i].ext))] = i + 1;
+    }
+    return true;
+}
+
+static bool mime_table_built = build_mime_table();
+
+const http_response::text& http_response::mime_type(const char* path, size_t len) {
+    size_t dot = len;
+    while (dot > 0 && path[dot - 1] != '.' && path[dot - 1] != '/') {
+        --dot;
+    }
+    if (dot == 0 || path[dot - 1] != '.' || dot == len) {
+        return mime_default;
+    }
+    const char* ext = path + dot;
+    size_t ext_len = len - dot;
+    int slot = mime_table[mime_hash(ext, ext_len)];
+    if (slot == 0) {
+        return mime_default;
+    }
+    const mime_entry& e = mime_entries[slot - 1];
+    if (strlen(e.ext) != ext_len || strncasecmp(ext, e.ext, ext_len) != 0) {
+        return mime_default;
+    }
+    return e.type;
+}
+
+int http_response::format_http_date(time_t t, char* buf, size_t size) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+time_t http_response::parse_http_date(const char* text) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') {
+        return -1;
+    }
+    return timegm(&tm);
+}
@@ -0,0 +1,195 @@
+#include <string.h>
+#include <strings.h>
+#include "http_scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+// 逐字节扫描, 也用于向量实现处理不足一个向量的尾部
+static size_t eol_scalar(const char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (p[i] == '\r' || p[i] == '\n')
+            return i;
+    }
+    return len;
+}
+
+static size_t colon_scalar(const char* p, size_t len) {
+    const void* q = memchr(p, ':', len);
+    return q ? static_cast<const char*>(q) - p : len;
+}
+
+#ifdef HTTP_SCAN_X86
+// SSE4.2: pcmpestri一次在16字节中查找字符集合中任一字符
+__attribute__((target("sse4.2")))
+static size_t eol_sse42(const char* p, size_t len) {
+    const __m128i set = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int idx = _mm_cmpestri(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return i + idx;
+    }
+    return i + eol_scalar(p + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t colon_sse42(const char* p, size_t len) {
+    const __m128i set = _mm_setr_epi8(':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int idx = _mm_cmpestri(set, 1, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return i + idx;
+    }
+    return i + colon_scalar(p + i, len - i);
+}
+
+// AVX2: 32字节逐字符比较后取掩码, 最低位即第一个匹配
+__attribute__((target("avx2")))
+static size_t eol_avx2(const char* p, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + eol_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t colon_avx2(const char* p, size_t len) {
+    const __m256i colon = _mm256_set1_epi8(':');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, colon));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + colon_scalar(p + i, len - i);
+}
+#endif
+
+http_scan::scan_fn http_scan::find_eol_ = eol_scalar;
+http_scan::scan_fn http_scan::find_colon_ = colon_scalar;
+const char* http_scan::impl_ = "scalar";
+
+bool http_scan::select(const char* name) {
+    if (strcmp(name, "scalar") == 0) {
+        find_eol_ = eol_scalar;
+        find_colon_ = colon_scalar;
+        impl_ = "scalar";
+        return true;
+    }
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        find_eol_ = eol_avx2;
+        find_colon_ = colon_avx2;
+        impl_ = "avx2";
+        return true;
+    }
+    if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        find_eol_ = eol_sse42;
+        find_colon_ = colon_sse42;
+        impl_ = "sse4.2";
+        return true;
+    }
+#endif
+    return false;
+}
+
+// 启动时选择CPU支持的最快实现
+static bool scan_selected = http_scan::select("avx2") || http_scan::select("sse4.2") || http_scan::select("scalar");
+
+// 完美哈希: 长度、首字符、中间字符和末字符(忽略大小写)组合后对32取模, 下表中的名字两两不冲突
+static const int HEADER_TABLE_SIZE = 32;
+
+static inline unsigned header_hash(const char* name, size_t len) {
+    return (len * 2 + (name[0] | 0x20) * 25 + (name[len - 1] | 0x20) * 18 + (name[len / 2] | 0x20)) & (HEADER_TABLE_SIZE - 1);
+}
+
+static const char* const header_names[http_scan::HDR_COUNT] = {
+    "",
+    "Connection",
+    "Content-Length",
+    "Content-Type",
+    "Host",
+    "If-None-Match",
+    "If-Modified-Since",
+    "Range",
+    "If-Range",
+    "Accept-Encoding",
+    "Cookie",
+    "Transfer-Encoding",
+    "User-Agent",
+    "Accept",
+    "Accept-Language",
+    "Referer",
+    "Expect",
+    "Upgrade",
+    "Authorization",
+    "Keep-Alive",
+    "Cache-Control",
+};
+
+struct header_slot {
+    unsigned char id;
+    unsigned char len;
+};
+
+// 哈希槽 -> 请求头编号, 在静态初始化时由header_names生成
+static header_slot header_table[HEADER_TABLE_SIZE];
+
+static bool build_header_table() {
+    for (int id = 1; id < http_scan::HDR_COUNT; ++id) {
+        size_t len = strlen(header_names[id]);
+        header_slot& slot = header_table[header_hash(header_names[id], len)];
+        slot.id = id;
+        slot.len = len;
+    }
+    return true;
+}
+
+static bool header_table_built = build_header_table();
+
+http_scan::HEADER_ID http_scan::lookup_header(const char* name, size_t len) {
+    if (len == 0) {
+        return HDR_UNKNOWN;
+    }
+    const header_slot& slot = header_table[header_hash(name, len)];
+    if (slot.len != len || strncasecmp(name, header_names[slot.id], len) != 0) {
+        return HDR_UNKNOWN;
+    }
+    return static_cast<HEADER_ID>(slot.id);
+}
+
+const char* http_scan::header_name(HEADER_ID id) {
+    return id > HDR_UNKNOWN && id < HDR_COUNT ? header_names[id] : "";
+}
+
+long http_scan::parse_length(const char* p, size_t len, long max) {
+    if (len == 0) {
+        return -1;
+    }
+    long value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        // 逐位检查上限, 不会溢出
+        value = value * 10 + (p[i] - '0');
+        if (value > max) {
+            return -1;
+        }
+    }
+    return value;
+}
@@ -1,45 +1,128 @@
 #include "log.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
 #include "string.h"
 
+// 线程退出时把缓冲区交给刷盘线程释放
+struct log_ring_owner {
+    log_ring* ring;
+    log_ring_owner() : ring(nullptr) {}
+    ~log_ring_owner() {
+        if (ring)
+            ring->orphan_.store(true, std::memory_order_release);
+    }
+};
+
+static thread_local log_ring_owner tls_ring;
+static thread_local std::vector<char> tls_scratch;  // 同步写和跨越环形缓冲区末尾的行先格式化到这里
+
+// 同一秒内的日志行复用本线程上一次localtime_r的结果
+static const struct tm& local_tm(time_t sec) {
+    static thread_local time_t cached = -1;
+    static thread_local struct tm tm;
+    if (sec != cached) {
+        localtime_r(&sec, &tm);
+        cached = sec;
+    }
+    return tm;
+}
+
+// 写出全部数据, 一次最多IOV_MAX段, 处理部分写
+static void write_all(int fd, struct iovec* iov, int cnt) {
+    while (cnt > 0) {
+        int batch = cnt < IOV_MAX ? cnt : IOV_MAX;
+        ssize_t n = writev(fd, iov, batch);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --cnt;
+        }
+        if (cnt > 0 && n > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
 Log::Log() {
+    split_lines_ = 5000000;
+    log_buf_size_ = 8192;
     count_ = 0; // 初始化日志行数计数
+    file_index_ = 0;
+    today_ = 0;
+    fd_ = -1;
     is_async_ = false; // 默认不使用异步日志
     close_log_ = 0; // 默认不关闭日志
+    flusher_running_ = false;
+    stop_.store(false);
 }
 Log::~Log() {
-    if (fp_) {
-        // fclose(fp_.get()); // 关闭文件指针
-        fclose(fp_); // 关闭文件指针
-        fp_ = nullptr; // 设置为空
+    stop_flusher();
+    if (fd_ >= 0) {
+        close(fd_); // 关闭日志文件
+        fd_ = -1;
+    }
+    // 仍在运行的线程可能还会写入自己的缓冲区, 只释放已退出线程的
+    for (size_t i = 0; i < rings_.size(); ++i) {
+        if (rings_[i]->orphan_.load(std::memory_order_acquire))
+            delete rings_[i];
     }
 }
+
 void Log::async_write_log() {
-    std::string single_log;
-    while (log_queue_->pop(single_log)) { // 从阻塞队列中取出日志
-        mutex_.lock(); // 加锁
-        // fputs(single_log.c_str(), fp_.get()); // 写入日志到文件
-        fputs(single_log.c_str(), fp_); // 写入日志到文件
-        mutex_.unlock(); // 解锁
+    while (!stop_.load(std::memory_order_acquire)) {
+        uint32_t key = wakeup_.prepare_wait();
+        if (stop_.load(std::memory_order_acquire)) {
+            wakeup_.cancel_wait();
+            break;
+        }
+        wakeup_.wait(key, FLUSH_INTERVAL_MS);
+        flush_mutex_.lock();
+        flush_rings();
+        flush_mutex_.unlock();
     }
 }
 
+void Log::stop_flusher() {
+    if (!flusher_running_)
+        return;
+    stop_.store(true, std::memory_order_release);
+    wakeup_.notify_all();
+    pthread_join(flusher_, nullptr);
+    flusher_running_ = false;
+    // 刷盘线程退出后写出剩余的日志
+    flush_mutex_.lock();
+    flush_rings();
+    flush_mutex_.unlock();
+}
+
 bool Log::init(const char* file_name, int close_log, int split_lines, int log_buf_size, int max_queue_size) {
-    // 如果设置了max_queue_size，则使用异步日志
-    if (max_queue_size > 0) {
-        is_async_ = true;
-        log_queue_ = std::make_shared<block_queue<std::string>>(max_queue_size);
-    } else {
-        is_async_ = false;
-    }
+    stop_flusher(); // 重复初始化时先写完旧文件
 
+    mutex_.lock();
+    is_async_ = max_queue_size > 0; // 如果设置了max_queue_size，则使用异步日志
     close_log_ = close_log; // 设置是否关闭日志
-    log_buf_size_ = log_buf_size; // 设置日志缓冲区大小
-    buf_.resize(log_buf_size, '\0'); // 初始化日志缓冲区
+    // 一行至少能放下时间和级别; 异步模式下一行不超过缓冲区的一半
+    if (log_buf_size < 64)
+        log_buf_size = 64;
+    if (is_async_ && log_buf_size > (int)RING_SIZE / 2)
+        log_buf_size = RING_SIZE / 2;
+    log_buf_size_ = log_buf_size; // 设置每行日志的最大长度
     split_lines_ = split_lines; // 设置每个日志文件的最大行数
+    count_ = 0;
+    file_index_ = 0;
 
     time_t t = time(nullptr);
-    struct tm* sys_tm = localtime(&t); // 获取当前时间
-    struct tm my_tm = *sys_tm; // 复制当前时间
+    struct tm my_tm;
+    localtime_r(&t, &my_tm); // 获取当前时间
 
     const char* p = strrchr(file_name, '/'); // 查找最后一个斜杠
     if (p == nullptr) {
@@ -50,88 +133,240 @@ bool Log::init(const char* file_name, int close_log, int split_lines, int log_bu
         log_name_ = p + 1; // 日志文件名为斜杠后的部分
     }
 
-    char log_full_name[256] = {0}; // 日志文件全名
-    snprintf(log_full_name, sizeof(log_full_name) - 1, "%s%d_%02d_%02d_%s", dir_name_.c_str(), my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, log_name_.c_str());
     today_ = my_tm.tm_mday; // 记录今天的日期
-    // fp_ = std::shared_ptr<FILE>(fopen(log_full_name, "a")); // 打开日志文件
-    fp_ = fopen(log_full_name, "a"); // 打开日志文件
-    if (!fp_) {
-        std::cerr << "Error opening log file: " << log_full_name << std::endl;
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    bool ok = open_file(my_tm, 0);
+    mutex_.unlock();
+    if (!ok) {
+        std::cerr << "Error opening log file: " << dir_name_ << log_name_ << std::endl;
         return false; // 打开日志文件失败
     }
+
+    if (is_async_) {
+        stop_.store(false, std::memory_order_release);
+        if (pthread_create(&flusher_, nullptr, flush_log_thread, this) == 0)
+            flusher_running_ = true;
+        else
+            is_async_ = false; // 创建线程失败时退回同步写
+    }
     return true; // 初始化成功
 }
 
-void Log::write_log(int level, const char* format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr); // 获取当前时间
-    time_t t = now.tv_sec; // 秒
-    struct tm* sys_tm = localtime(&t); // 转换为本地时间
-    struct tm my_tm = *sys_tm; // 复制本地时间
+bool Log::open_file(const struct tm& tm, long long index) {
+    char name[256] = {0};
+    if (index > 0) {
+        snprintf(name, sizeof(name) - 1, "%s%d_%02d_%02d_%s.%lld", dir_name_.c_str(), tm.tm_year + 1900,
+                 tm.tm_mon + 1, tm.tm_mday, log_name_.c_str(), index);
+    } else {
+        snprintf(name, sizeof(name) - 1, "%s%d_%02d_%02d_%s", dir_name_.c_str(), tm.tm_year + 1900,
+                 tm.tm_mon + 1, tm.tm_mday, log_name_.c_str());
+    }
+    int fd = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;   // 打不开新文件时继续写旧文件
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = fd;
+    return true;
+}
+
+void Log::rotate(const struct tm& tm, long long lines) {
+    if (today_ != tm.tm_mday) {    // 日期变化, 换到新一天的文件
+        today_ = tm.tm_mday;
+        count_ = 0;
+        file_index_ = 0;
+        open_file(tm, 0);
+    }
+    count_ += lines;
+    if (split_lines_ > 0 && count_ / split_lines_ > file_index_) {  // 行数达到上限, 文件名加上序号
+        file_index_ = count_ / split_lines_;
+        open_file(tm, file_index_);
+    }
+}
 
-    char s[16] = {0}; // 时间字符串
+int Log::format_header(char* dst, int level, const struct timeval& now) {
+    const char* s;
     switch (level) {
-        case 0: strcpy(s, "[debug]:"); break;
-        case 1: strcpy(s, "[info]:"); break;
-        case 2: strcpy(s, "[warn]:"); break;
-        case 3: strcpy(s, "[error]:"); break;
-        default: strcpy(s, "[info]:"); break; // 默认级别为info
-    }
-
-    mutex_.lock(); // 加锁
-    ++count_; // 增加日志行数计数
-    if (today_ != my_tm.tm_mday || count_ % split_lines_ == 0) {    // 如果日期变化或行数达到上限，则重新打开日志文件
-        char new_log[256] = {0};
-        // fflush(fp_.get()); // 刷新文件缓冲区
-        // fclose(fp_.get()); // 关闭当前日志文件
-        fflush(fp_); // 刷新文件缓冲区
-        fclose(fp_); // 关闭当前日志文件
-        char tail[16] = {0}; // 日志文件尾部
-        snprintf(tail, sizeof(tail)-1, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
-
-        if (today_ != my_tm.tm_mday) {
-            snprintf(new_log, sizeof(new_log)-1, "%s%s%s", dir_name_.c_str(), tail, log_name_.c_str()); // 新日志文件名
-            today_ = my_tm.tm_mday; // 更新今天的日期
-        } else {
-            snprintf(new_log, sizeof(new_log)-1, "%s%s%s.%lld", dir_name_.c_str(), tail, log_name_.c_str(), count_ / split_lines_); // 日志文件名加上行数
-        }
-        // fp_ = std::shared_ptr<FILE>(fopen(new_log, "a")); // 打开新的日志文件
-        fp_ = fopen(new_log, "a"); // 打开新的日志文件
+        case 0: s = "[debug]:"; break;
+        case 1: s = "[info]:"; break;
+        case 2: s = "[warn]:"; break;
+        case 3: s = "[error]:"; break;
+        default: s = "[info]:"; break; // 默认级别为info
+    }
+    const struct tm& my_tm = local_tm(now.tv_sec);
+    return snprintf(dst, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ", my_tm.tm_year + 1900, my_tm.tm_mon + 1,
+                    my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, (long)now.tv_usec, s);
+}
+
+int Log::format_line(char* dst, int level, const struct timeval& now, const char* format, va_list valst) {
+    int n = format_header(dst, level, now);
+    int m = vsnprintf(dst + n, log_buf_size_ - 1 - n, format, valst); // 格式化日志内容
+    if (m < 0) m = 0;
+    if (m > log_buf_size_ - 2 - n) m = log_buf_size_ - 2 - n; // 超长内容被截断, 换行符写在缓冲区末尾
+    dst[n + m] = '\n'; // 添加换行符, 不写结束符
+    return n + m + 1;
+}
 
+log_ring* Log::local_ring() {
+    if (!tls_ring.ring) {
+        tls_ring.ring = new log_ring(RING_SIZE);
+        mutex_.lock();
+        rings_.push_back(tls_ring.ring);
+        mutex_.unlock();
     }
+    return tls_ring.ring;
+}
 
-    mutex_.unlock(); // 解锁
+void Log::write_log(int level, const char* format, ...) {
+    if (close_log_)
+        return;
+    struct timeval now = {0, 0};
+    gettimeofday(&now, nullptr); // 获取当前时间
 
     va_list valst; // 可变参数列表
     va_start(valst, format); // 初始化可变参数列表
 
-    std::string log_str;
+    if (tls_scratch.size() < (size_t)log_buf_size_)
+        tls_scratch.resize(log_buf_size_);
 
-    mutex_.lock(); // 加锁
-
-    int n = snprintf(buf_.data(), 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    int m = vsnprintf(buf_.data() + n, log_buf_size_ - 1 - n, format, valst); // 格式化日志内容
-    buf_[n + m] = '\n'; // 添加换行符
-    buf_[n + m + 1] = '\0'; // 添加字符串结束符
-    log_str = std::string(buf_.data()); // 转换为字符串
-    mutex_.unlock(); // 解锁
+    if (!is_async_) {
+        // 同步写: 格式化不加锁, 加锁只为切分文件和一次write(2)
+        int len = format_line(tls_scratch.data(), level, now, format, valst);
+        mutex_.lock();
+        if (fd_ >= 0) {
+            rotate(local_tm(now.tv_sec), 1);
+            ssize_t ret = write(fd_, tls_scratch.data(), len);
+            (void)ret;
+        }
+        mutex_.unlock();
+        va_end(valst);
+        return;
+    }
 
-    if(is_async_ && !log_queue_->full()) {
-        log_queue_->push(log_str); // 如果是异步日志，则将日志内容放入阻塞队列
+    // 异步写: 只访问本线程的缓冲区. 尾部到末尾能放下最长的一行时直接格式化进去,
+    // 否则先格式化到临时缓冲区再分两段拷贝; 剩余空间不够时丢弃并计数, 不等待刷盘
+    log_ring* r = local_ring();
+    const size_t mask = r->capacity_ - 1;
+    uint64_t tail = r->tail_.load(std::memory_order_relaxed);
+    uint64_t head = r->head_.load(std::memory_order_acquire);
+    size_t space = r->capacity_ - (size_t)(tail - head);
+    size_t off = tail & mask;
+    size_t contiguous = r->capacity_ - off;
+    size_t len;
+    if (space >= (size_t)log_buf_size_ && contiguous >= (size_t)log_buf_size_) {
+        len = format_line(r->data_ + off, level, now, format, valst);
     } else {
-        mutex_.lock(); // 如果不是异步日志，则直接写入文件
-        // fputs(log_str.c_str(), fp_.get()); // 写入日志到文件
-        fputs(log_str.c_str(), fp_); // 写入日志到文件
-        mutex_.unlock(); // 解锁
+        len = format_line(tls_scratch.data(), level, now, format, valst);
+        if (len > space) {
+            r->dropped_.fetch_add(1, std::memory_order_relaxed);
+            wakeup_.notify_one();
+            va_end(valst);
+            return;
+        }
+        size_t first = len < contiguous ? len : contiguous;
+        memcpy(r->data_ + off, tls_scratch.data(), first);
+        memcpy(r->data_, tls_scratch.data() + first, len - first);
     }
-
     va_end(valst); // 结束可变参数列表
+
+    r->lines_.store(r->lines_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    r->tail_.store(tail + len, std::memory_order_release);
+    // 本次写入使缓冲区超过一半时提前唤醒刷盘线程
+    size_t half = r->capacity_ / 2;
+    if (tail - head <= half && tail + len - head > half)
+        wakeup_.notify_one();
 }
-void Log::flush() {
+
+void Log::flush_rings() {
     mutex_.lock();
-    if (fp_) {
-        // fflush(fp_.get()); // 刷新文件缓冲区
-        fflush(fp_); // 刷新文件缓冲区
+    snapshot_ = rings_;
+    mutex_.unlock();
+    ends_.resize(snapshot_.size());
+    iov_.clear();
+
+    long long lines = 0;
+    unsigned long long dropped = 0;
+    for (size_t i = 0; i < snapshot_.size(); ++i) {
+        log_ring* r = snapshot_[i];
+        uint64_t head = r->head_.load(std::memory_order_relaxed);
+        uint64_t tail = r->tail_.load(std::memory_order_acquire);
+        ends_[i] = tail;
+        uint64_t l = r->lines_.load(std::memory_order_relaxed);
+        lines += l - r->flushed_lines_;
+        r->flushed_lines_ = l;
+        uint64_t d = r->dropped_.load(std::memory_order_relaxed);
+        dropped += d - r->flushed_dropped_;
+        r->flushed_dropped_ = d;
+        if (tail == head)
+            continue;
+        // 已提交的部分跨过缓冲区末尾时分两段
+        size_t off = head & (r->capacity_ - 1);
+        size_t n = tail - head;
+        size_t first = n < r->capacity_ - off ? n : r->capacity_ - off;
+        struct iovec v;
+        v.iov_base = r->data_ + off;
+        v.iov_len = first;
+        iov_.push_back(v);
+        if (n > first) {
+            v.iov_base = r->data_;
+            v.iov_len = n - first;
+            iov_.push_back(v);
+        }
+    }
+
+    char note[128];
+    if (dropped > 0) {
+        struct timeval now = {0, 0};
+        gettimeofday(&now, nullptr);
+        int n = format_header(note, 2, now);
+        n += snprintf(note + n, sizeof(note) - n, "%llu log lines dropped, ring buffer full\n", dropped);
+        struct iovec v;
+        v.iov_base = note;
+        v.iov_len = n;
+        iov_.push_back(v);
+        ++lines;
+    }
+
+    if (!iov_.empty()) {
+        time_t t = time(nullptr);
+        struct tm my_tm;
+        localtime_r(&t, &my_tm);
+        rotate(my_tm, lines);   // 一批日志写入同一个文件
+        if (fd_ >= 0)
+            write_all(fd_, iov_.data(), (int)iov_.size());
+    }
+
+    bool orphans = false;
+    for (size_t i = 0; i < snapshot_.size(); ++i) {
+        snapshot_[i]->head_.store(ends_[i], std::memory_order_release);
+        if (snapshot_[i]->orphan_.load(std::memory_order_acquire))
+            orphans = true;
     }
-    mutex_.unlock(); // 解锁
-}
\ No newline at end of file
+    if (!orphans)
+        return;
+    // 线程已退出且缓冲区已写空, 释放缓冲区
+    mutex_.lock();
+    size_t kept = 0;
+    for (size_t i = 0; i < rings_.size(); ++i) {
+        log_ring* r = rings_[i];
+        if (r->orphan_.load(std::memory_order_acquire) &&
+            r->tail_.load(std::memory_order_acquire) == r->head_.load(std::memory_order_relaxed)) {
+            delete r;
+        } else {
+            rings_[kept++] = r;
+        }
+    }
+    rings_.resize(kept);
+    mutex_.unlock();
+}
+
+void Log::flush() {
+    if (!is_async_)
+        return;
+    flush_mutex_.lock();
+    flush_rings();
+    flush_mutex_.unlock();
+}
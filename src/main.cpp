@@ -1,4 +1,35 @@
+#include <string>
+#include "config.hpp"
+#include "webserver.hpp"
 
-int main() {
-    
-}
\ No newline at end of file
+int main(int argc, char* argv[]) {
+    // 需要修改的数据库信息: 登录名, 密码, 库名
+    std::string user = "root";
+    std::string passwd = "root";
+    std::string database_name = "webserver";
+
+    // 命令行解析
+    Config config;
+    config.parse_arg(argc, argv);
+
+    WebServer server;
+
+    // 初始化
+    server.init(config.port, user, passwd, database_name, config.log_write,
+                config.opt_linger, config.trig_mode, config.sql_num,
+                config.thread_num, config.min_thread, config.close_log, config.actor_model,
+                config.reactor_num, config.io_backend, config.zero_copy,
+                config.file_cache_mb, config.work_stealing,
+                config.cpu_affinity, config.nic, config.max_conn,
+                config.queue_deadline_ms);
+
+    server.log_write();     // 日志
+    server.sql_pool();      // 数据库
+    server.cpu_affinity();  // 绑核和NUMA放置
+    server.thread_pool();   // 线程池
+    server.trig_mode();     // 触发模式
+    server.event_listen();  // 监听
+    server.event_loop();    // 运行
+
+    return 0;
+}
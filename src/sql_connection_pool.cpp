@@ -23,8 +23,8 @@ connection_pool *connection_pool::GetInstance()
 //构造初始化
 void connection_pool::init(std::string url, std::string User, std::string PassWord, std::string DBName, int Port, int MaxConn, int close_log)
 {
-	url = url;
-	port = Port;
+	this->url = url;
+	port = std::to_string(Port);
 	user = User;
 	password = PassWord;
 	database_name = DBName;
@@ -130,12 +130,17 @@ connection_pool::~connection_pool()
 }
 
 connectionRAII::connectionRAII(MYSQL **SQL, connection_pool *connPool){
-	*SQL = connPool->GetConnection();
-	
+	*SQL = connPool ? connPool->GetConnection() : NULL;
+
+	sqlRAII = SQL;
 	conRAII = *SQL;
 	poolRAII = connPool;
 }
 
+//归还后清空调用者的指针, 之后可以据此判断手上有没有连接; 没有取连接时不再访问调用者的对象
 connectionRAII::~connectionRAII(){
-	poolRAII->ReleaseConnection(conRAII);
+	if (poolRAII) {
+		poolRAII->ReleaseConnection(conRAII);
+		*sqlRAII = NULL;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "sub_reactor.hpp"
+#include "cpu_topology.hpp"
+
+sub_reactor::sub_reactor()
+    : id_(0), port_(0), listenfd_(-1), epollfd_(-1), wakeup_fd_(-1), thread_(0), cpu_(-1), steer_incoming_(false), stop_(false),
+      users_(nullptr), max_fd_(0), conn_config_(nullptr), listen_trig_mode_(0), conn_trig_mode_(0),
+      opt_linger_(0), close_log_(0), conn_pool_(nullptr), timers_(nullptr), now_ms_(0), user_count_(0), request_count_(0)
+{
+}
+
+sub_reactor::~sub_reactor() {
+    if (listenfd_ != -1) close(listenfd_);
+    if (epollfd_ != -1) close(epollfd_);
+    if (wakeup_fd_ != -1) close(wakeup_fd_);
+    delete timers_;
+}
+
+void sub_reactor::init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int listen_trig_mode,
+                       int conn_trig_mode, int opt_linger, connection_pool* conn_pool) {
+    id_ = id;
+    port_ = port;
+    users_ = users;
+    max_fd_ = max_fd;
+    conn_config_ = conn_config;
+    listen_trig_mode_ = listen_trig_mode;
+    conn_trig_mode_ = conn_trig_mode;
+    opt_linger_ = opt_linger;
+    close_log_ = conn_config->close_log;
+    conn_pool_ = conn_pool;
+}
+
+bool sub_reactor::start() {
+    listenfd_ = socket(PF_INET, SOCK_STREAM, 0);
+    if (listenfd_ < 0) {
+        return false;
+    }
+
+    // 优雅关闭连接
+    struct linger tmp = {opt_linger_ == 1 ? 1 : 0, 1};
+    setsockopt(listenfd_, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+
+    // 每个事件循环绑定同一端口, 由内核在监听socket之间分摊新连接
+    int flag = 1;
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    // 内核6.2起在SO_REUSEPORT组内优先选择incoming cpu与收包CPU相同的监听socket
+    if (steer_incoming_ && cpu_ >= 0)
+        setsockopt(listenfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu_, sizeof(cpu_));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port_);
+    if (bind(listenfd_, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenfd_, 5) < 0) {
+        LOG_ERROR("sub reactor %d listen error: errno is %d", id_, errno);
+        return false;
+    }
+
+    epollfd_ = epoll_create(5);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (epollfd_ == -1 || wakeup_fd_ == -1) {
+        return false;
+    }
+    addfd(epollfd_, listenfd_, false, listen_trig_mode_);
+    addfd(epollfd_, wakeup_fd_, false, 0);
+
+    if (cpu_topology::create_thread(&thread_, cpu_, worker, this) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void sub_reactor::stop() {
+    stop_ = true;
+    uint64_t one = 1;
+    if (wakeup_fd_ != -1) {
+        ::write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+void sub_reactor::join() {
+    if (thread_) {
+        pthread_join(thread_, nullptr);
+        thread_ = 0;
+    }
+}
+
+void* sub_reactor::worker(void* arg) {
+    sub_reactor* loop = static_cast<sub_reactor*>(arg);
+    loop->run();
+    return loop;
+}
+
+void sub_reactor::deal_client_data() {
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+
+    // LT只接受一个连接, ET需要一次性接受所有连接
+    do {
+        int connfd = accept(listenfd_, (struct sockaddr*)&client_address, &client_addrlength);
+        if (connfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            }
+            return;
+        }
+        if (connfd >= max_fd_ || http_conn::user_count_ >= conn_config_->max_conn) {
+            // 连接数已到上限, 回复503后关闭; ET模式下继续accept, 把积压的连接都拒绝掉
+            http_conn::send_busy(connfd);
+            close(connfd);
+            LOG_ERROR("%s", "Internal server busy");
+            continue;
+        }
+        users_[connfd].init(connfd, client_address, conn_config_, conn_trig_mode_, epollfd_, &user_count_);
+        timers_->add(connfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    } while (1 == listen_trig_mode_);
+}
+
+void sub_reactor::close_conn(int sockfd) {
+    timers_->remove(sockfd);
+    users_[sockfd].close_conn();
+}
+
+void sub_reactor::deal_with_read(int sockfd) {
+    http_conn* conn = users_ + sockfd;
+    if (!conn->read_once()) {
+        close_conn(sockfd);
+        return;
+    }
+    timers_->adjust(sockfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    ++request_count_;
+    // 只有POST请求取数据库连接, 静态文件请求不在连接池上等待
+    connectionRAII mysqlcon(&conn->mysql_, conn->needs_db() ? conn_pool_ : nullptr);
+    conn->process();
+}
+
+void sub_reactor::deal_with_write(int sockfd) {
+    http_conn* conn = users_ + sockfd;
+    if (!conn->write()) {
+        close_conn(sockfd);
+        return;
+    }
+    timers_->adjust(sockfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    // 读缓冲区中还有流水线请求, 直接继续处理
+    if (conn->has_pending_input()) {
+        connectionRAII mysqlcon(&conn->mysql_, conn->needs_db() ? conn_pool_ : nullptr);
+        conn->process();
+    }
+}
+
+void sub_reactor::run() {
+    // 时间轮按最大描述符数分配, 在本线程内分配和首次写入, 绑核时落在本线程所在的NUMA节点上
+    timers_ = new timer_wheel(max_fd_);
+    while (!stop_) {
+        int timeout = timers_->next_timeout(timer_wheel::now_ms());
+        int number = epoll_wait(epollfd_, events_, MAX_EVENT_NUMBER, timeout);
+        if (number < 0 && errno != EINTR) {
+            LOG_ERROR("sub reactor %d epoll failure", id_);
+            break;
+        }
+        now_ms_ = timer_wheel::now_ms();
+
+        for (int i = 0; i < number; i++) {
+            int sockfd = events_[i].data.fd;
+
+            if (sockfd == listenfd_) {
+                deal_client_data();
+            } else if (sockfd == wakeup_fd_) {
+                uint64_t cnt;
+                ::read(wakeup_fd_, &cnt, sizeof(cnt));
+            } else if (events_[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                close_conn(sockfd);
+            } else if (events_[i].events & EPOLLIN) {
+                deal_with_read(sockfd);
+            } else if (events_[i].events & EPOLLOUT) {
+                deal_with_write(sockfd);
+            }
+        }
+
+        // 处理超时的非活动连接
+        timers_->tick(now_ms_, [this](int sockfd) {
+            LOG_INFO("close idle connection %d", sockfd);
+            users_[sockfd].close_conn();
+        });
+    }
+    LOG_INFO("sub reactor %d exit, connections: %d, reads: %lld", id_, user_count_, request_count_);
+}
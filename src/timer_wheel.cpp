@@ -0,0 +1,150 @@
+#include <time.h>
+#include "timer_wheel.hpp"
+
+timer_wheel::timer_wheel(int capacity, int tick_ms)
+    : tick_ms_(tick_ms > 0 ? tick_ms : 1), count_(0), nodes_(capacity)
+{
+    cur_ = now_ms() / tick_ms_;
+    for (int i = 0; i < capacity; ++i) {
+        nodes_[i].level = -1;
+    }
+    for (int l = 0; l < LEVELS; ++l) {
+        bitmap_[l] = 0;
+        for (int s = 0; s < SLOTS; ++s) {
+            heads_[l][s] = -1;
+        }
+    }
+}
+
+uint64_t timer_wheel::now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 按到期时间与当前tick的差值选择层和槽
+void timer_wheel::link(int id) {
+    node& n = nodes_[id];
+    uint64_t expire = n.expire;
+    int level = 0;
+    int slot;
+    if (expire <= cur_) {
+        // 级联时已经到期的节点放入当前槽, 本tick内处理
+        slot = (int)(cur_ & (SLOTS - 1));
+    } else {
+        uint64_t delta = expire - cur_;
+        while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        // 超出最高层范围的放在最高层最远的槽, 到时再按lazy规则重新挂入
+        if (delta >= (1ULL << (SLOT_BITS * LEVELS))) {
+            expire = cur_ + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+        }
+        slot = (int)((expire >> (SLOT_BITS * level)) & (SLOTS - 1));
+    }
+
+    n.level = level;
+    n.slot = slot;
+    n.prev = -1;
+    n.next = heads_[level][slot];
+    if (n.next != -1) {
+        nodes_[n.next].prev = id;
+    }
+    heads_[level][slot] = id;
+    bitmap_[level] |= 1ULL << slot;
+    ++count_;
+}
+
+void timer_wheel::unlink(int id) {
+    node& n = nodes_[id];
+    if (n.prev != -1) {
+        nodes_[n.prev].next = n.next;
+    } else {
+        heads_[n.level][n.slot] = n.next;
+        if (n.next == -1) {
+            bitmap_[n.level] &= ~(1ULL << n.slot);
+        }
+    }
+    if (n.next != -1) {
+        nodes_[n.next].prev = n.prev;
+    }
+    n.level = -1;
+    --count_;
+}
+
+// 每层的槽走完一圈时, 把上一层对应槽里的节点按剩余时间重新分配到下层
+void timer_wheel::cascade() {
+    int top = 0;
+    while (top < LEVELS - 1 && ((cur_ >> (SLOT_BITS * top)) & (SLOTS - 1)) == 0) {
+        ++top;
+    }
+    for (int level = top; level >= 1; --level) {
+        int slot = (int)((cur_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+        int id = heads_[level][slot];
+        heads_[level][slot] = -1;
+        bitmap_[level] &= ~(1ULL << slot);
+        while (id != -1) {
+            int next = nodes_[id].next;
+            --count_;
+            link(id);
+            id = next;
+        }
+    }
+}
+
+void timer_wheel::add(int id, uint64_t expire_ms) {
+    if (id < 0 || id >= (int)nodes_.size()) {
+        return;
+    }
+    if (nodes_[id].level >= 0) {
+        unlink(id);
+    }
+    uint64_t expire = (expire_ms + tick_ms_ - 1) / tick_ms_;
+    nodes_[id].expire = expire > cur_ ? expire : cur_ + 1;
+    link(id);
+}
+
+void timer_wheel::adjust(int id, uint64_t expire_ms) {
+    if (!contains(id)) {
+        return;
+    }
+    uint64_t expire = (expire_ms + tick_ms_ - 1) / tick_ms_;
+    if (expire > nodes_[id].expire) {
+        nodes_[id].expire = expire;
+    }
+}
+
+void timer_wheel::remove(int id) {
+    if (contains(id)) {
+        unlink(id);
+    }
+}
+
+int timer_wheel::next_timeout(uint64_t now_ms) const {
+    if (count_ == 0) {
+        return -1;
+    }
+    uint64_t target = 0;
+    // 下一个非空的第0层槽
+    if (bitmap_[0]) {
+        int start = (int)((cur_ + 1) & (SLOTS - 1));
+        uint64_t rotated = (bitmap_[0] >> start) | (start ? bitmap_[0] << (SLOTS - start) : 0);
+        target = cur_ + 1 + __builtin_ctzll(rotated);
+    }
+    // 上层有节点时, 下一次级联可能带来更早的到期
+    for (int l = 1; l < LEVELS; ++l) {
+        if (bitmap_[l]) {
+            uint64_t boundary = (cur_ | (SLOTS - 1)) + 1;
+            if (target == 0 || boundary < target) {
+                target = boundary;
+            }
+            break;
+        }
+    }
+    uint64_t target_ms = target * tick_ms_;
+    if (target_ms <= now_ms) {
+        return 0;
+    }
+    uint64_t wait = target_ms - now_ms;
+    return wait > 0x7fffffff ? 0x7fffffff : (int)wait;
+}
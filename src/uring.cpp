@@ -0,0 +1,239 @@
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.hpp"
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+uring::uring()
+    : ring_fd_(-1), sq_ptr_(MAP_FAILED), sq_len_(0), sqes_(nullptr), sqes_len_(0), sqe_tail_(0),
+      cq_ptr_(MAP_FAILED), cq_len_(0), buf_ring_(nullptr), buf_ring_len_(0), bufs_(nullptr),
+      buf_count_(0), buf_size_(0), buf_tail_(0)
+{
+}
+
+uring::~uring() {
+    if (buf_ring_) munmap(buf_ring_, buf_ring_len_);
+    free(bufs_);
+    if (sqes_) munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_len_);
+    if (ring_fd_ != -1) close(ring_fd_);
+}
+
+bool uring::init(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    ring_fd_ = sys_io_uring_setup(entries, &p);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_len_ > sq_len_) sq_len_ = cq_len_;
+        cq_len_ = sq_len_;
+    }
+
+    sq_ptr_ = mmap(0, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(0, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(0, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    // SQ array固定为恒等映射, 之后只需推进tail
+    for (unsigned i = 0; i < p.sq_entries; ++i) {
+        sq_array_[i] = i;
+    }
+    sqe_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+}
+
+bool uring::setup_buf_ring(unsigned short bgid, unsigned count, unsigned size) {
+    // count必须是2的幂
+    if (count == 0 || (count & (count - 1)) != 0) {
+        return false;
+    }
+    buf_ring_len_ = count * sizeof(io_uring_buf);
+    void* ring = mmap(0, buf_ring_len_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<unsigned long long>(buf_ring_);
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+
+    buf_count_ = count;
+    buf_size_ = size;
+    bufs_ = static_cast<char*>(malloc((size_t)count * size));
+    if (!bufs_) {
+        return false;
+    }
+    buf_tail_ = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        recycle_buf(i);
+    }
+    return true;
+}
+
+void uring::recycle_buf(unsigned short bid) {
+    // C++下内核头文件的柔性数组前有一个空结构体占位, bufs偏移不为0, 这里按C布局直接计算
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buf_ring_) + (buf_tail_ & (buf_count_ - 1));
+    buf->addr = reinterpret_cast<unsigned long long>(buf_addr(bid));
+    buf->len = buf_size_;
+    buf->bid = bid;
+    ++buf_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+io_uring_sqe* uring::get_sqe() {
+    // 前面有积压时新的SQE也排在积压之后, 保持提交顺序(如writev在取消它的SQE之前)
+    if (backlog_.empty()) {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head > *sq_mask_) {
+            enter(0);
+            head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        }
+        if (sqe_tail_ - head <= *sq_mask_) {
+            io_uring_sqe* sqe = &sqes_[sqe_tail_ & *sq_mask_];
+            memset(sqe, 0, sizeof(*sqe));
+            ++sqe_tail_;
+            return sqe;
+        }
+    }
+    backlog_.push_back(io_uring_sqe());
+    memset(&backlog_.back(), 0, sizeof(io_uring_sqe));
+    return &backlog_.back();
+}
+
+bool uring::drain_backlog() {
+    size_t n = 0;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    while (n < backlog_.size() && sqe_tail_ - head <= *sq_mask_) {
+        sqes_[sqe_tail_ & *sq_mask_] = backlog_[n++];
+        ++sqe_tail_;
+    }
+    backlog_.erase(backlog_.begin(), backlog_.begin() + n);
+    return backlog_.empty();
+}
+
+void uring::prep_accept_multishot(int fd, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_recv_multishot(int fd, unsigned short bgid, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_read(int fd, void* buf, unsigned len, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long long>(buf);
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_writev(int fd, const iovec* iov, int iov_count, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long long>(iov);
+    sqe->len = iov_count;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_cancel(unsigned long long target, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_timeout(__kernel_timespec* ts, unsigned long long user_data) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<unsigned long long>(ts);
+    sqe->len = 1;
+    sqe->user_data = user_data;
+}
+
+int uring::submit_and_wait(unsigned wait_nr) {
+    // 积压超过提交队列容量时分批提交, 全部提交后才等待完成事件
+    while (!drain_backlog()) {
+        int ret = enter(0);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+    return enter(wait_nr);
+}
+
+int uring::enter(unsigned wait_nr) {
+    // 发布本地填充的SQE
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    // 未被内核消费的SQE都需要提交, 上次enter被信号打断时也不会遗漏
+    unsigned submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    return sys_io_uring_enter(ring_fd_, submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+}
@@ -0,0 +1,382 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "uring_reactor.hpp"
+#include "cpu_topology.hpp"
+
+uring_reactor::uring_reactor()
+    : id_(0), port_(0), listenfd_(-1), wakeup_fd_(-1), wakeup_val_(0), thread_(0), cpu_(-1), steer_incoming_(false), stop_(false),
+      users_(nullptr), max_fd_(0), conn_config_(nullptr), opt_linger_(0), close_log_(0), conn_pool_(nullptr),
+      timers_(nullptr), now_ms_(0), timer_armed_(false), user_count_(0), request_count_(0)
+{
+}
+
+uring_reactor::~uring_reactor() {
+    if (listenfd_ != -1) close(listenfd_);
+    if (wakeup_fd_ != -1) close(wakeup_fd_);
+    delete timers_;
+}
+
+void uring_reactor::init(int id, int port, http_conn* users, int max_fd, http_conn::config* conn_config, int opt_linger,
+                         connection_pool* conn_pool) {
+    id_ = id;
+    port_ = port;
+    users_ = users;
+    max_fd_ = max_fd;
+    conn_config_ = conn_config;
+    opt_linger_ = opt_linger;
+    close_log_ = conn_config->close_log;
+    conn_pool_ = conn_pool;
+}
+
+bool uring_reactor::start() {
+    if (!ring_.init(RING_ENTRIES) || !ring_.setup_buf_ring(BUF_GROUP, BUF_COUNT, BUF_SIZE)) {
+        LOG_ERROR("uring reactor %d: io_uring setup failure, errno is %d", id_, errno);
+        return false;
+    }
+
+    listenfd_ = socket(PF_INET, SOCK_STREAM, 0);
+    if (listenfd_ < 0) {
+        return false;
+    }
+
+    // 优雅关闭连接
+    struct linger tmp = {opt_linger_ == 1 ? 1 : 0, 1};
+    setsockopt(listenfd_, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+
+    // 每个事件循环绑定同一端口, 由内核在监听socket之间分摊新连接
+    int flag = 1;
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd_, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    // 内核6.2起在SO_REUSEPORT组内优先选择incoming cpu与收包CPU相同的监听socket
+    if (steer_incoming_ && cpu_ >= 0)
+        setsockopt(listenfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu_, sizeof(cpu_));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port_);
+    if (bind(listenfd_, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenfd_, 5) < 0) {
+        LOG_ERROR("uring reactor %d listen error: errno is %d", id_, errno);
+        return false;
+    }
+
+    wakeup_fd_ = eventfd(0, 0);
+    if (wakeup_fd_ == -1) {
+        return false;
+    }
+
+    if (cpu_topology::create_thread(&thread_, cpu_, worker, this) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void uring_reactor::stop() {
+    stop_ = true;
+    uint64_t one = 1;
+    if (wakeup_fd_ != -1) {
+        ::write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+void uring_reactor::join() {
+    if (thread_) {
+        pthread_join(thread_, nullptr);
+        thread_ = 0;
+    }
+}
+
+void* uring_reactor::worker(void* arg) {
+    uring_reactor* loop = static_cast<uring_reactor*>(arg);
+    loop->run();
+    return loop;
+}
+
+void uring_reactor::run() {
+    // 连接状态表和时间轮按最大描述符数分配, 在本线程内首次写入, 绑核时落在本线程所在的NUMA节点上
+    states_.resize(max_fd_);
+    timers_ = new timer_wheel(max_fd_);
+    ring_.prep_accept_multishot(listenfd_, pack(OP_ACCEPT, 0, 0));
+    ring_.prep_read(wakeup_fd_, &wakeup_val_, sizeof(wakeup_val_), pack(OP_WAKEUP, 0, 0));
+
+    while (!stop_) {
+        // 本轮产生的所有SQE在这里一次性提交
+        int ret = ring_.submit_and_wait(1);
+        // 完成队列溢出时内核暂不接受提交(EBUSY), 先收割完成事件再提交
+        if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            LOG_ERROR("uring reactor %d io_uring_enter failure: errno is %d", id_, errno);
+            break;
+        }
+        now_ms_ = timer_wheel::now_ms();
+        ring_.for_each_cqe([this](const io_uring_cqe* cqe) { handle_cqe(cqe); });
+
+        // 处理超时的非活动连接
+        timers_->tick(now_ms_, [this](int fd) {
+            LOG_INFO("close idle connection %d", fd);
+            close_conn(fd);
+        });
+        arm_timer();
+    }
+    LOG_INFO("uring reactor %d exit, connections: %d, recvs: %lld", id_, user_count_, request_count_);
+}
+
+void uring_reactor::handle_cqe(const io_uring_cqe* cqe) {
+    int op = (int)(cqe->user_data >> 56);
+    unsigned gen = (unsigned)(cqe->user_data >> 24);
+    int fd = (int)(cqe->user_data & 0xffffff);
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    switch (op) {
+    case OP_ACCEPT:
+    {
+        if (cqe->res >= 0) {
+            on_accept(cqe->res);
+        } else {
+            LOG_ERROR("%s:errno is:%d", "accept error", -cqe->res);
+        }
+        if (!more && !stop_) {
+            ring_.prep_accept_multishot(listenfd_, pack(OP_ACCEPT, 0, 0));
+        }
+        break;
+    }
+    case OP_RECV:
+    {
+        bool has_buf = cqe->flags & IORING_CQE_F_BUFFER;
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        conn_state& st = states_[fd];
+        // fd已关闭或被复用, 只归还缓冲区
+        if (gen != st.gen || users_[fd].sockfd() != fd) {
+            if (has_buf) ring_.recycle_buf(bid);
+            break;
+        }
+        if (!more) {
+            st.receiving = false;
+        }
+        // 连接正在关闭: 丢弃数据, 多路recv结束后释放连接
+        if (st.closing) {
+            if (has_buf) ring_.recycle_buf(bid);
+            if (!more) release_conn(fd);
+            break;
+        }
+        if (cqe->res > 0 && has_buf) {
+            ++request_count_;
+            if (st.writing) {
+                hold(fd, ring_.buf_addr(bid), cqe->res);
+            } else {
+                on_data(fd, ring_.buf_addr(bid), cqe->res);
+            }
+            ring_.recycle_buf(bid);
+        } else if (has_buf) {
+            ring_.recycle_buf(bid);
+        }
+        // 处理数据时连接已被关闭
+        if (gen != st.gen || st.closing) {
+            break;
+        }
+
+        if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && !(cqe->res == -ECANCELED && st.throttled))) {
+            close_conn(fd);
+        } else if (!more && (!st.throttled || !st.writing)) {
+            // 缓冲区耗尽或内核终止了多路recv, 重新提交; 因pending到达上限取消的等响应发完再提交
+            st.throttled = false;
+            start_recv(fd);
+        }
+        break;
+    }
+    case OP_WRITE:
+    {
+        conn_state& st = states_[fd];
+        if (gen != st.gen || users_[fd].sockfd() != fd) {
+            break;
+        }
+        // 本次writev已结束, 需要继续发送时start_write重新置位
+        st.writing = false;
+        if (st.closing) {
+            release_conn(fd);
+            break;
+        }
+        on_write(fd, cqe->res);
+        break;
+    }
+    case OP_TIMER:
+        timer_armed_ = false;
+        break;
+    case OP_WAKEUP:
+    default:
+        break;
+    }
+}
+
+void uring_reactor::on_accept(int connfd) {
+    if (connfd >= max_fd_ || http_conn::user_count_ >= conn_config_->max_conn) {
+        // 连接数已到上限, 回复503后关闭
+        http_conn::send_busy(connfd);
+        close(connfd);
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+    // 多路accept不返回对端地址
+    struct sockaddr_in client_address;
+    memset(&client_address, 0, sizeof(client_address));
+    users_[connfd].init(connfd, client_address, conn_config_, 0, -1, &user_count_);
+
+    conn_state& st = states_[connfd];
+    ++st.gen;
+    st.writing = false;
+    st.closing = false;
+    st.throttled = false;
+    st.pending.clear();
+    start_recv(connfd);
+    timers_->add(connfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+}
+
+void uring_reactor::on_data(int fd, const char* data, int len) {
+    http_conn* conn = users_ + fd;
+    conn_state& st = states_[fd];
+    int n = conn->append_read(data, len);
+    if (n == 0) {
+        close_conn(fd);
+        return;
+    }
+    timers_->adjust(fd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    unsigned gen = st.gen;
+    serve(fd);
+    // 读缓冲区放不下的部分等这批响应发完再处理; 没有可发送的响应说明请求超过了缓冲区上限
+    if (n < len && st.gen == gen && !st.closing) {
+        if (st.writing) {
+            hold(fd, data + n, len - n);
+        } else {
+            close_conn(fd);
+        }
+    }
+}
+
+// 处理读缓冲区中的请求, 响应就绪后提交writev
+void uring_reactor::serve(int fd) {
+    int ret;
+    {
+        // 只有POST请求取数据库连接
+        connectionRAII mysqlcon(&users_[fd].mysql_, users_[fd].needs_db() ? conn_pool_ : nullptr);
+        ret = users_[fd].prepare_response();
+    }
+    if (ret < 0) {
+        close_conn(fd);
+    } else if (ret > 0) {
+        start_write(fd);
+    }
+}
+
+void uring_reactor::start_recv(int fd) {
+    states_[fd].receiving = true;
+    ring_.prep_recv_multishot(fd, BUF_GROUP, pack(OP_RECV, states_[fd].gen, fd));
+}
+
+// 发送响应期间到达的数据暂存到pending. 客户端只发不收时不能无限增长: 到达读缓冲区上限后取消多路recv,
+// 之后只会再收到取消生效前内核已经投递的数据, 响应发完后由on_write恢复接收
+void uring_reactor::hold(int fd, const char* data, int len) {
+    conn_state& st = states_[fd];
+    st.pending.append(data, len);
+    if (st.pending.size() >= (size_t)http_conn::MAX_READ_BUFFER_SIZE && st.receiving && !st.throttled) {
+        st.throttled = true;
+        ring_.prep_cancel(pack(OP_RECV, st.gen, fd), pack(OP_CANCEL, 0, 0));
+    }
+}
+
+void uring_reactor::start_write(int fd) {
+    states_[fd].writing = true;
+    ring_.prep_writev(fd, users_[fd].write_iov(), users_[fd].write_iov_count(), pack(OP_WRITE, states_[fd].gen, fd));
+}
+
+void uring_reactor::on_write(int fd, int res) {
+    http_conn* conn = users_ + fd;
+    if (res < 0) {
+        if (res == -EAGAIN || res == -EINTR) {
+            start_write(fd);
+            return;
+        }
+        conn->finish_write();
+        close_conn(fd);
+        return;
+    }
+    if (!conn->advance_write(res)) {
+        start_write(fd);
+        return;
+    }
+
+    timers_->adjust(fd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    conn_state& st = states_[fd];
+    st.writing = false;
+    if (!conn->finish_write()) {
+        close_conn(fd);
+        return;
+    }
+    // 发送期间到达的数据在连接重置后继续处理
+    unsigned gen = st.gen;
+    if (!st.pending.empty()) {
+        std::string pending;
+        pending.swap(st.pending);
+        on_data(fd, pending.data(), pending.size());
+    } else if (conn->has_pending_input()) {
+        serve(fd);
+    }
+    // 暂存的数据降到上限以下后恢复被取消的接收; 被取消的recv还没结束时由它的最后一个完成事件恢复
+    if (st.gen == gen && !st.closing && st.throttled && !st.receiving &&
+        st.pending.size() < (size_t)http_conn::MAX_READ_BUFFER_SIZE) {
+        st.throttled = false;
+        start_recv(fd);
+    }
+}
+
+// 时间轮非空且没有在途超时SQE时, 以最近期限提交一个超时SQE唤醒事件循环
+void uring_reactor::arm_timer() {
+    if (timer_armed_) {
+        return;
+    }
+    int timeout = timers_->next_timeout(timer_wheel::now_ms());
+    if (timeout < 0) {
+        return;
+    }
+    timer_ts_.tv_sec = timeout / 1000;
+    timer_ts_.tv_nsec = (long long)(timeout % 1000) * 1000000;
+    ring_.prep_timeout(&timer_ts_, pack(OP_TIMER, 0, 0));
+    timer_armed_ = true;
+}
+
+void uring_reactor::close_conn(int fd) {
+    conn_state& st = states_[fd];
+    if (st.closing) {
+        return;
+    }
+    timers_->remove(fd);
+    st.closing = true;
+    st.pending.clear();
+    if (!st.receiving && !st.writing) {
+        release_conn(fd);
+        return;
+    }
+    // 在途的recv/writev还在使用连接的缓冲区和iovec, 等它们的完成事件到达后再由release_conn释放;
+    // 描述符保持打开, 编号不会被复用. shutdown让阻塞在对端的writev尽快失败返回
+    shutdown(fd, SHUT_RDWR);
+    if (st.receiving) {
+        ring_.prep_cancel(pack(OP_RECV, st.gen, fd), pack(OP_CANCEL, 0, 0));
+    }
+    if (st.writing) {
+        ring_.prep_cancel(pack(OP_WRITE, st.gen, fd), pack(OP_CANCEL, 0, 0));
+    }
+}
+
+// 在途操作全部完成后释放连接资源并关闭描述符
+void uring_reactor::release_conn(int fd) {
+    conn_state& st = states_[fd];
+    if (st.receiving || st.writing) {
+        return;
+    }
+    ++st.gen;
+    st.closing = false;
+    st.pending.clear();
+    users_[fd].close_conn();
+}
@@ -0,0 +1,530 @@
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include "webserver.hpp"
+
+int WebServer::pipefd_[2] = {-1, -1};
+
+WebServer::WebServer()
+    : epollfd_(-1), conn_slab_(MAX_FD), conn_pool_(nullptr), pool_(nullptr), db_pool_(nullptr), min_thread_(0), work_stealing_(0),
+      queue_deadline_ms_(0), cpu_affinity_(0), steer_incoming_(false), timers_(MAX_FD), now_ms_(0), reactor_num_(0), reactors_(nullptr),
+      io_backend_(0), uring_reactors_(nullptr), coro_reactors_(nullptr), listenfd_(-1)
+{
+    // http_conn类对象
+    users_ = conn_slab_.data();
+
+    // 网站根目录: 当前工作目录下的root文件夹
+    char server_path[200];
+    if (getcwd(server_path, sizeof(server_path)) == nullptr) {
+        throw std::exception();
+    }
+    conn_config_.doc_root = std::string(server_path) + "/root";
+}
+
+WebServer::~WebServer() {
+    // 先等工作线程处理完已入队的连接并退出, 它们还会用到epoll和连接对象;
+    // 快车道还可能把请求转给数据库车道, 先回收快车道
+    delete pool_;
+    delete db_pool_;
+    if (epollfd_ != -1) close(epollfd_);
+    if (listenfd_ != -1) close(listenfd_);
+    if (pipefd_[0] != -1) close(pipefd_[0]);
+    if (pipefd_[1] != -1) close(pipefd_[1]);
+    delete[] reactors_;
+    delete[] uring_reactors_;
+#ifdef HAVE_COROUTINE
+    delete[] coro_reactors_;
+#endif
+}
+
+void WebServer::init(int port, std::string user, std::string passwd, std::string database_name,
+                     int log_write, int opt_linger, int trig_mode, int sql_num,
+                     int thread_num, int min_thread, int close_log, int actor_model, int reactor_num, int io_backend,
+                     int zero_copy, int file_cache_mb, int work_stealing,
+                     int cpu_affinity, std::string nic, int max_conn, int queue_deadline_ms) {
+    port_ = port;
+    user_ = user;
+    passwd_ = passwd;
+    database_name_ = database_name;
+    sql_num_ = sql_num;
+    thread_num_ = thread_num;
+    min_thread_ = min_thread;
+    work_stealing_ = work_stealing;
+    cpu_affinity_ = cpu_affinity;
+    nic_ = nic;
+    log_write_ = log_write;
+    opt_linger_ = opt_linger;
+    trig_mode_ = trig_mode;
+    close_log_ = close_log;
+    conn_config_.close_log = close_log;
+    conn_config_.max_conn = max_conn > 0 && max_conn < MAX_FD ? max_conn : MAX_FD;
+    queue_deadline_ms_ = queue_deadline_ms;
+    actor_model_ = actor_model;
+    reactor_num_ = reactor_num;
+    io_backend_ = io_backend;
+#ifndef HAVE_COROUTINE
+    // 编译器不支持C++20协程时没有协程后端, 退回epoll
+    if (2 == io_backend_)
+        io_backend_ = 0;
+#endif
+    // io_uring和协程后端至少需要一个事件循环
+    if (io_backend_ > 0 && reactor_num_ <= 0)
+        reactor_num_ = 1;
+    // sendfile需要在socket上同步推进, io_uring和协程后端仍使用mmap+writev
+    http_conn::zero_copy_ = (1 == zero_copy && 0 == io_backend_);
+    // 所有事件循环和工作线程共享同一个静态文件缓存
+    if (file_cache_mb > 0)
+        file_cache::get_instance()->init((size_t)file_cache_mb << 20);
+}
+
+void WebServer::trig_mode() {
+    // LT + LT
+    if (0 == trig_mode_) {
+        listen_trig_mode_ = 0;
+        conn_trig_mode_ = 0;
+    }
+    // LT + ET
+    else if (1 == trig_mode_) {
+        listen_trig_mode_ = 0;
+        conn_trig_mode_ = 1;
+    }
+    // ET + LT
+    else if (2 == trig_mode_) {
+        listen_trig_mode_ = 1;
+        conn_trig_mode_ = 0;
+    }
+    // ET + ET
+    else {
+        listen_trig_mode_ = 1;
+        conn_trig_mode_ = 1;
+    }
+}
+
+void WebServer::log_write() {
+    if (0 == close_log_) {
+        // 初始化日志, 异步日志写入各线程的环形缓冲区, 由刷盘线程批量写出
+        if (1 == log_write_)
+            Log::get_instance()->init("./ServerLog", close_log_, 800000, 2000, 800);
+        else
+            Log::get_instance()->init("./ServerLog", close_log_, 800000, 2000, 0);
+    }
+}
+
+void WebServer::sql_pool() {
+    // 初始化数据库连接池
+    conn_pool_ = connection_pool::GetInstance();
+    conn_pool_->init("localhost", user_, passwd_, database_name_, 3306, sql_num_, close_log_);
+
+    // 初始化数据库读取表
+    http_conn::initmysql_result(conn_pool_, &conn_config_);
+    // 由用户表生成的动态页面
+    http_conn::register_handlers(&conn_config_);
+}
+
+void WebServer::cpu_affinity() {
+    if (0 == cpu_affinity_ && nic_.empty())
+        return;
+    topology_.load();
+    const std::vector<int>& order = topology_.placement();
+    std::vector<int> irq_cpus;
+    if (!nic_.empty()) {
+        irq_cpus = topology_.nic_irq_cpus(nic_);
+        if (irq_cpus.empty())
+            LOG_WARN("no usable irq cpu for %s, fall back to topology order", nic_.c_str());
+    }
+
+    // 事件循环优先放在网卡各队列中断所在的CPU上, 收包、accept和请求处理在同一个核上; 否则按绑核顺序依次放
+    int loops = reactor_num_ > 0 ? reactor_num_ : 1;
+    for (int i = 0; i < loops; ++i)
+        loop_cpus_.push_back(irq_cpus.empty() ? order[i % order.size()] : irq_cpus[i % irq_cpus.size()]);
+    steer_incoming_ = !irq_cpus.empty() && reactor_num_ > 0;
+
+    if (0 == reactor_num_) {
+        // 工作线程先放在主线程所在节点的其他CPU上, 再放到其他节点
+        int main_cpu = loop_cpus_[0];
+        int main_node = topology_.node_of(main_cpu);
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (order[i] != main_cpu && topology_.node_of(order[i]) == main_node)
+                worker_cpus_.push_back(order[i]);
+        }
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (topology_.node_of(order[i]) != main_node)
+                worker_cpus_.push_back(order[i]);
+        }
+        if (worker_cpus_.empty())
+            worker_cpus_.push_back(main_cpu);
+        // 之后由主线程创建的线程都显式指定CPU, 不继承主线程的绑定
+        cpu_topology::pin_thread(pthread_self(), main_cpu);
+    }
+
+    // 连接对象以描述符为下标由所有事件循环共用, 放在事件循环所在的节点上, 跨节点时在这些节点间交错分配
+    if (topology_.node_count() > 1) {
+        std::vector<int> nodes;
+        for (size_t i = 0; i < loop_cpus_.size(); ++i) {
+            int node = topology_.node_of(loop_cpus_[i]);
+            if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+                nodes.push_back(node);
+        }
+        if (!cpu_topology::bind_memory(conn_slab_.data(), conn_slab_.bytes(), nodes))
+            LOG_WARN("bind connection slab to numa node failure: errno is %d", errno);
+    }
+    LOG_INFO("cpu affinity: %d cpus on %d numa nodes, %d loops from cpu %d, steer incoming %d",
+             (int)order.size(), topology_.node_count(), loops, loop_cpus_[0], steer_incoming_ ? 1 : 0);
+}
+
+void WebServer::thread_pool() {
+    // 多reactor模式下请求在各事件循环线程内处理
+    if (reactor_num_ > 0)
+        return;
+    // 快车道处理静态请求, 不取数据库连接; POST请求走数据库车道, 线程数与连接池大小相同, 取连接不会排队
+    pool_ = new threadpool<http_conn>(actor_model_, nullptr, thread_num_, 10000, 1 == work_stealing_,
+                                      min_thread_, threadpool<http_conn>::IDLE_MS, worker_cpus_);
+    db_pool_ = new threadpool<http_conn>(0, conn_pool_, sql_num_ > 0 ? sql_num_ : 1, 10000, false, 0,
+                                         threadpool<http_conn>::IDLE_MS, worker_cpus_);
+    pool_->set_db_lane(db_pool_);
+    pool_->set_queue_deadline(queue_deadline_ms_);
+    db_pool_->set_queue_deadline(queue_deadline_ms_);
+}
+
+void WebServer::event_listen() {
+    // epoll创建内核事件表
+    epollfd_ = epoll_create(5);
+    assert(epollfd_ != -1);
+
+    int ret = 0;
+    // 多reactor模式: 监听socket由各事件循环各自创建, 主线程只处理信号
+    if (reactor_num_ > 0) {
+        start_reactors();
+    } else {
+        // 网络编程基础步骤
+        listenfd_ = socket(PF_INET, SOCK_STREAM, 0);
+        assert(listenfd_ >= 0);
+
+        // 优雅关闭连接
+        if (0 == opt_linger_) {
+            struct linger tmp = {0, 1};
+            setsockopt(listenfd_, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        } else if (1 == opt_linger_) {
+            struct linger tmp = {1, 1};
+            setsockopt(listenfd_, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        }
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port_);
+
+        int flag = 1;
+        setsockopt(listenfd_, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        ret = bind(listenfd_, (struct sockaddr*)&address, sizeof(address));
+        assert(ret >= 0);
+        ret = listen(listenfd_, 5);
+        assert(ret >= 0);
+
+        addfd(epollfd_, listenfd_, false, listen_trig_mode_);
+    }
+
+    // 信号通过管道统一交给事件循环处理
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd_);
+    assert(ret != -1);
+    setnonblocking(pipefd_[1]);
+    addfd(epollfd_, pipefd_[0], false, 0);
+
+    add_sig(SIGPIPE, SIG_IGN);
+    add_sig(SIGTERM, sig_handler, false);
+    add_sig(SIGINT, sig_handler, false);
+}
+
+void WebServer::start_reactors() {
+#ifdef HAVE_COROUTINE
+    if (2 == io_backend_) {
+        // 各事件循环的数据库车道平分连接池
+        int db_threads = sql_num_ / reactor_num_ > 0 ? sql_num_ / reactor_num_ : 1;
+        coro_reactors_ = new coro_reactor[reactor_num_];
+        for (int i = 0; i < reactor_num_; ++i) {
+            coro_reactors_[i].init(i, port_, users_, MAX_FD, &conn_config_, opt_linger_, conn_pool_, db_threads);
+            if (!loop_cpus_.empty())
+                coro_reactors_[i].set_cpu(loop_cpus_[i], steer_incoming_);
+            if (!coro_reactors_[i].start()) {
+                LOG_ERROR("start coro reactor %d failure", i);
+                throw std::exception();
+            }
+        }
+        return;
+    }
+#endif
+    if (1 == io_backend_) {
+        uring_reactors_ = new uring_reactor[reactor_num_];
+        for (int i = 0; i < reactor_num_; ++i) {
+            uring_reactors_[i].init(i, port_, users_, MAX_FD, &conn_config_, opt_linger_, conn_pool_);
+            if (!loop_cpus_.empty())
+                uring_reactors_[i].set_cpu(loop_cpus_[i], steer_incoming_);
+            if (!uring_reactors_[i].start()) {
+                LOG_ERROR("start uring reactor %d failure", i);
+                throw std::exception();
+            }
+        }
+        return;
+    }
+
+    reactors_ = new sub_reactor[reactor_num_];
+    for (int i = 0; i < reactor_num_; ++i) {
+        reactors_[i].init(i, port_, users_, MAX_FD, &conn_config_, listen_trig_mode_, conn_trig_mode_,
+                          opt_linger_, conn_pool_);
+        if (!loop_cpus_.empty())
+            reactors_[i].set_cpu(loop_cpus_[i], steer_incoming_);
+        if (!reactors_[i].start()) {
+            LOG_ERROR("start sub reactor %d failure", i);
+            throw std::exception();
+        }
+    }
+}
+
+void WebServer::stop_reactors() {
+#ifdef HAVE_COROUTINE
+    if (2 == io_backend_) {
+        for (int i = 0; i < reactor_num_; ++i) {
+            coro_reactors_[i].stop();
+        }
+        for (int i = 0; i < reactor_num_; ++i) {
+            coro_reactors_[i].join();
+        }
+        return;
+    }
+#endif
+    if (1 == io_backend_) {
+        for (int i = 0; i < reactor_num_; ++i) {
+            uring_reactors_[i].stop();
+        }
+        for (int i = 0; i < reactor_num_; ++i) {
+            uring_reactors_[i].join();
+        }
+        return;
+    }
+
+    for (int i = 0; i < reactor_num_; ++i) {
+        reactors_[i].stop();
+    }
+    for (int i = 0; i < reactor_num_; ++i) {
+        reactors_[i].join();
+    }
+}
+
+void WebServer::sig_handler(int sig) {
+    // 为保证函数的可重入性，保留原来的errno
+    int save_errno = errno;
+    int msg = sig;
+    send(pipefd_[1], (char*)&msg, 1, 0);
+    errno = save_errno;
+}
+
+void WebServer::add_sig(int sig, void (*handler)(int), bool restart) {
+    struct sigaction sa;
+    memset(&sa, '\0', sizeof(sa));
+    sa.sa_handler = handler;
+    if (restart)
+        sa.sa_flags |= SA_RESTART;
+    sigfillset(&sa.sa_mask);
+    assert(sigaction(sig, &sa, NULL) != -1);
+}
+
+bool WebServer::deal_client_data() {
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+
+    // LT只接受一个连接, ET需要一次性接受所有连接
+    do {
+        int connfd = accept(listenfd_, (struct sockaddr*)&client_address, &client_addrlength);
+        if (connfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            }
+            return false;
+        }
+        if (connfd >= MAX_FD || http_conn::user_count_ >= conn_config_.max_conn) {
+            // 连接数已到上限, 回复503后关闭; ET模式下继续accept, 把积压的连接都拒绝掉
+            http_conn::send_busy(connfd);
+            close(connfd);
+            LOG_ERROR("%s", "Internal server busy");
+            continue;
+        }
+        users_[connfd].init(connfd, client_address, &conn_config_, conn_trig_mode_, epollfd_);
+        timers_.add(connfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+    } while (1 == listen_trig_mode_);
+    return true;
+}
+
+bool WebServer::deal_with_signal(bool& stop_server) {
+    char signals[1024];
+    int ret = recv(pipefd_[0], signals, sizeof(signals), 0);
+    if (ret <= 0) {
+        return false;
+    }
+    for (int i = 0; i < ret; ++i) {
+        switch (signals[i]) {
+        case SIGTERM:
+        case SIGINT:
+            stop_server = true;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+// reactor模式下主线程等待工作线程完成读写, 失败时由主线程关闭连接
+void WebServer::wait_worker(int sockfd) {
+    while (true) {
+        if (1 == users_[sockfd].improv) {
+            if (1 == users_[sockfd].timer_flag) {
+                close_conn(sockfd);
+                users_[sockfd].timer_flag = 0;
+            }
+            users_[sockfd].improv = 0;
+            break;
+        }
+    }
+}
+
+// proactor模式下按已读入的请求选择车道, 队列满时拒绝
+void WebServer::dispatch(int sockfd) {
+    threadpool<http_conn>* lane = users_[sockfd].needs_db() ? db_pool_ : pool_;
+    if (lane->append_p_batched(users_ + sockfd))
+        users_[sockfd].mark_dispatched();
+    else
+        reject(sockfd);
+}
+
+// 线程池队列已满: 不再让连接挂着等客户端超时, 立即回复503并关闭
+void WebServer::reject(int sockfd) {
+    LOG_WARN("work queue full, reject %d", sockfd);
+    users_[sockfd].shed();
+    close_conn(sockfd);
+}
+
+void WebServer::close_conn(int sockfd) {
+    timers_.remove(sockfd);
+    users_[sockfd].close_conn();
+}
+
+// 只改写到期时间, 不移动时间轮节点
+void WebServer::refresh_timer(int sockfd) {
+    timers_.adjust(sockfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+}
+
+void WebServer::deal_with_read(int sockfd) {
+    refresh_timer(sockfd);
+
+    // reactor: 读事件交给工作线程, 由工作线程完成读取和处理
+    if (1 == actor_model_) {
+        if (pool_->append(users_ + sockfd, 0)) {
+            users_[sockfd].mark_dispatched();
+            wait_worker(sockfd);
+        } else {
+            reject(sockfd);
+        }
+    }
+    // proactor: 主线程完成读取, 工作线程只负责处理
+    else {
+        if (users_[sockfd].read_once()) {
+            LOG_INFO("deal with the client(%s)", inet_ntoa(users_[sockfd].get_address()->sin_addr));
+            dispatch(sockfd);
+        } else {
+            close_conn(sockfd);
+        }
+    }
+}
+
+void WebServer::deal_with_write(int sockfd) {
+    refresh_timer(sockfd);
+
+    // reactor
+    if (1 == actor_model_) {
+        if (pool_->append(users_ + sockfd, 1)) {
+            users_[sockfd].mark_dispatched();
+            wait_worker(sockfd);
+        } else {
+            close_conn(sockfd);     // 响应已发出一部分, 不能再插入503
+        }
+    }
+    // proactor
+    else {
+        if (users_[sockfd].write()) {
+            LOG_INFO("send data to the client(%s)", inet_ntoa(users_[sockfd].get_address()->sin_addr));
+            // 读缓冲区中还有流水线请求, 交给工作线程继续处理
+            if (users_[sockfd].has_pending_input()) {
+                dispatch(sockfd);
+            }
+        } else {
+            close_conn(sockfd);
+        }
+    }
+}
+
+void WebServer::event_loop() {
+    bool stop_server = false;
+
+    while (!stop_server) {
+        // 以最近的定时器期限作为epoll_wait超时
+        int timeout = timers_.next_timeout(timer_wheel::now_ms());
+        int number = epoll_wait(epollfd_, events_, MAX_EVENT_NUMBER, timeout);
+        if (number < 0 && errno != EINTR) {
+            LOG_ERROR("%s", "epoll failure");
+            break;
+        }
+        now_ms_ = timer_wheel::now_ms();
+
+        for (int i = 0; i < number; i++) {
+            int sockfd = events_[i].data.fd;
+
+            // 处理新到的客户连接
+            if (sockfd == listenfd_) {
+                deal_client_data();
+            }
+            // 服务器端关闭连接
+            // 连接还在工作线程手中时不能关闭, 工作线程重新注册事件后挂断会再次报告
+            else if (events_[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                if (!users_[sockfd].in_worker())
+                    close_conn(sockfd);
+            }
+            // 处理信号
+            else if ((sockfd == pipefd_[0]) && (events_[i].events & EPOLLIN)) {
+                if (!deal_with_signal(stop_server))
+                    LOG_ERROR("%s", "dealclientdata failure");
+            }
+            // 处理客户连接上接收到的数据
+            else if (events_[i].events & EPOLLIN) {
+                deal_with_read(sockfd);
+            }
+            else if (events_[i].events & EPOLLOUT) {
+                deal_with_write(sockfd);
+            }
+        }
+        // 本轮批量入队的任务一次性唤醒工作线程; 多reactor模式下主线程只处理信号, 没有线程池
+        if (pool_) {
+            pool_->flush();
+            db_pool_->flush();
+        }
+
+        // 处理超时的非活动连接; 工作线程或数据库车道还在处理的连接(如POST等待慢查询)不能关闭,
+        // 重新计时, 工作线程交还后由读写事件照常刷新
+        timers_.tick(now_ms_, [this](int sockfd) {
+            if (users_[sockfd].in_worker()) {
+                timers_.add(sockfd, now_ms_ + http_conn::IDLE_TIMEOUT_MS);
+                return;
+            }
+            LOG_INFO("close idle connection %d", sockfd);
+            users_[sockfd].close_conn();
+        });
+    }
+
+    if (reactor_num_ > 0) {
+        stop_reactors();
+    }
+}
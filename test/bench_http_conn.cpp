@@ -0,0 +1,118 @@
+#include "http_conn.hpp"
+#include "object_slab.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// 长连接请求循环的微基准: 不经过socket, 用append_read喂入请求, prepare_response生成响应,
+// 假装全部写出后finish_write进入下一个请求. 对比旧版init()每个请求清零读写缓冲区和文件名(共3272字节)的开销.
+// 用法: bench_http_conn [连接数] [每个连接的请求数]
+
+static const int OLD_RESET_BYTES = 2048 + 1024 + 200;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 模拟旧版每个请求的重置: 清零旧的定长读写缓冲区和文件名
+static void legacy_reset(char* area) {
+    memset(area, 0, 2048);
+    memset(area + 2048, 0, 1024);
+    memset(area + 3072, 0, 200);
+}
+
+static double run(http_conn* conns, int conn_num, int rounds, char* legacy, const char* req, int req_len) {
+    double begin = now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < conn_num; ++i) {
+            http_conn& c = conns[i];
+            if (legacy) {
+                legacy_reset(legacy + (size_t)i * OLD_RESET_BYTES);
+            }
+            c.append_read(req, req_len);
+            if (c.prepare_response() != 1) {
+                fprintf(stderr, "bad response\n");
+                exit(1);
+            }
+            long bytes = 0;
+            for (int k = 0; k < c.write_iov_count(); ++k) {
+                bytes += c.write_iov()[k].iov_len;
+            }
+            c.advance_write(bytes);
+            c.finish_write();
+        }
+    }
+    return (now_ns() - begin) / ((double)rounds * conn_num);
+}
+
+int main(int argc, char* argv[]) {
+    int conn_num = argc > 1 ? atoi(argv[1]) : 1024;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+    char root[] = "/tmp/bench_http_conn_XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/index.html", root);
+    FILE* fp = fopen(path, "w");
+    fputs("<html><body>bench</body></html>\n", fp);
+    fclose(fp);
+
+    const char req[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+                       "User-Agent: bench\r\nAccept: */*\r\n\r\n";
+    // 打开文件缓存, 去掉stat/open/mmap的系统调用, 只剩解析、生成响应和重置
+    file_cache::get_instance()->init(1 << 20);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    http_conn::config cfg;
+    cfg.doc_root = root;
+    cfg.close_log = 1;
+    object_slab<http_conn> slab(conn_num);
+    http_conn* conns = slab.data();
+    for (int i = 0; i < conn_num; ++i) {
+        conns[i].init(-1, addr, &cfg, 0, -1);
+    }
+    char* legacy = static_cast<char*>(malloc((size_t)conn_num * OLD_RESET_BYTES));
+
+    // 先各跑一轮预热缓冲池和页缓存
+    run(conns, conn_num, 1, nullptr, req, sizeof(req) - 1);
+    run(conns, conn_num, 1, legacy, req, sizeof(req) - 1);
+
+    // 两种方式交替各跑5次取最好成绩, 减少调度和频率变化的干扰
+    double lazy = 1e30, old = 1e30, memset_only = 1e30;
+    for (int rep = 0; rep < 5; ++rep) {
+        double t = run(conns, conn_num, rounds, nullptr, req, sizeof(req) - 1);
+        lazy = t < lazy ? t : lazy;
+        t = run(conns, conn_num, rounds, legacy, req, sizeof(req) - 1);
+        old = t < old ? t : old;
+
+        double begin = now_ns();
+        for (int r = 0; r < rounds; ++r) {
+            for (int i = 0; i < conn_num; ++i) {
+                legacy_reset(legacy + (size_t)i * OLD_RESET_BYTES);
+            }
+        }
+        t = (now_ns() - begin) / ((double)rounds * conn_num);
+        memset_only = t < memset_only ? t : memset_only;
+    }
+
+    printf("connections=%d rounds=%d\n", conn_num, rounds);
+    printf("lazy reset:          %7.1f ns/request\n", lazy);
+    printf("with legacy memsets: %7.1f ns/request\n", old);
+    printf("legacy memsets only: %7.1f ns/request\n", memset_only);
+
+    for (int i = 0; i < conn_num; ++i) {
+        conns[i].close_conn();
+    }
+    free(legacy);
+    unlink(path);
+    rmdir(root);
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "threadpool.hpp"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <list>
+
+// 线程池任务交接的吞吐: 主线程(相当于主事件循环)连续投递空任务, 工作线程取出后只做一次原子加,
+// 对比旧版std::list+互斥锁+信号量的队列、无锁环形队列+自旋/futex休眠和每线程Chase-Lev双端队列+工作窃取;
+// 后两种再各测一次批量投递: 每EPOLL_ROUND个任务flush一次, 相当于一轮epoll_wait返回的事件. 数据库连接池未初始化,
+// connectionRAII取不到连接直接返回, 测到的只有交接本身的开销.
+// 用法: bench_threadpool [每轮任务数]
+
+static std::atomic<long> done(0);
+
+struct task {
+    int state_;
+    std::atomic<int> improv;
+    std::atomic<int> timer_flag;
+    uint64_t enqueue_ms_;
+    MYSQL* mysql_;
+
+    task() : state_(0), improv(0), timer_flag(0), enqueue_ms_(0), mysql_(nullptr) {}
+    bool read_once() { return true; }
+    bool write() { return true; }
+    bool has_pending_input() const { return false; }
+    bool needs_db() const { return false; }
+    void shed() {}
+    void request_close() {}
+    void mark_returned() {}
+    void process() { done.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// 旧版线程池的队列部分, 只保留proactor模式
+class legacy_threadpool {
+public:
+    legacy_threadpool(connection_pool* conn_pool, int thread_num, int max_request)
+        : max_requests_(max_request), conn_pool_(conn_pool) {
+        for (int i = 0; i < thread_num; ++i) {
+            pthread_t tid;
+            pthread_create(&tid, nullptr, worker, this);
+            pthread_detach(tid);
+        }
+    }
+
+    bool append_p(task* request) {
+        queue_locker_.lock();
+        if (work_queue_.size() >= (size_t)max_requests_) {
+            queue_locker_.unlock();
+            return false;
+        }
+        work_queue_.push_back(request);
+        queue_locker_.unlock();
+        queue_sem_.post();
+        return true;
+    }
+
+private:
+    static void* worker(void* arg) {
+        static_cast<legacy_threadpool*>(arg)->run();
+        return arg;
+    }
+
+    void run() {
+        while (true) {
+            queue_sem_.wait();
+            queue_locker_.lock();
+            if (work_queue_.empty()) {
+                queue_locker_.unlock();
+                continue;
+            }
+            task* request = work_queue_.front();
+            work_queue_.pop_front();
+            queue_locker_.unlock();
+            connectionRAII mysqlcon(&request->mysql_, conn_pool_);
+            request->process();
+        }
+    }
+
+    int max_requests_;
+    std::list<task*> work_queue_;
+    locker queue_locker_;
+    sem queue_sem_;
+    connection_pool* conn_pool_;
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 投递n个任务并等待全部完成, 返回每秒交接的任务数
+template <typename POOL>
+static double run(POOL* pool, task* tasks, int task_num, long n) {
+    done.store(0);
+    double begin = now_ns();
+    for (long i = 0; i < n; ++i) {
+        while (!pool->append_p(&tasks[i % task_num])) {
+            sched_yield();  // 队列满, 让工作线程追上
+        }
+    }
+    while (done.load() < n) {
+        sched_yield();
+    }
+    return n / ((now_ns() - begin) / 1e9);
+}
+
+static const int EPOLL_ROUND = 64;
+
+// 批量投递, 每EPOLL_ROUND个任务统一唤醒一次
+static double run_batched(threadpool<task>* pool, task* tasks, int task_num, long n) {
+    done.store(0);
+    double begin = now_ns();
+    for (long i = 0; i < n; ++i) {
+        while (!pool->append_p_batched(&tasks[i % task_num])) {
+            pool->flush();
+            sched_yield();
+        }
+        if (i % EPOLL_ROUND == EPOLL_ROUND - 1) {
+            pool->flush();
+        }
+    }
+    pool->flush();
+    while (done.load() < n) {
+        sched_yield();
+    }
+    return n / ((now_ns() - begin) / 1e9);
+}
+
+int main(int argc, char* argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 200000;
+    const int task_num = 1024;
+    const int max_request = 10000;
+    static task tasks[task_num];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+
+    printf("tasks=%ld cpus=%ld\n", n, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %16s %16s %16s %16s %16s\n", "workers", "list+mutex+sem", "mpmc+futex", "ws-deque+steal",
+           "mpmc batched", "ws batched");
+    for (int workers = 1; workers <= 64; workers *= 2) {
+        // 旧版线程池没有停止接口, 测完的线程留在休眠状态, 池对象不释放
+        legacy_threadpool* legacy = new legacy_threadpool(conn_pool, workers, max_request);
+        threadpool<task>* ring = new threadpool<task>(0, conn_pool, workers, max_request);
+        threadpool<task>* steal = new threadpool<task>(0, conn_pool, workers, max_request, true);
+        // 各自先跑一轮预热, 再交替跑3次取最好成绩
+        run(legacy, tasks, task_num, n / 10);
+        run(ring, tasks, task_num, n / 10);
+        run(steal, tasks, task_num, n / 10);
+        run_batched(ring, tasks, task_num, n / 10);
+        run_batched(steal, tasks, task_num, n / 10);
+        double best_legacy = 0, best_ring = 0, best_steal = 0, best_ring_batched = 0, best_steal_batched = 0;
+        for (int rep = 0; rep < 3; ++rep) {
+            double t = run(legacy, tasks, task_num, n);
+            best_legacy = t > best_legacy ? t : best_legacy;
+            t = run(ring, tasks, task_num, n);
+            best_ring = t > best_ring ? t : best_ring;
+            t = run(steal, tasks, task_num, n);
+            best_steal = t > best_steal ? t : best_steal;
+            t = run_batched(ring, tasks, task_num, n);
+            best_ring_batched = t > best_ring_batched ? t : best_ring_batched;
+            t = run_batched(steal, tasks, task_num, n);
+            best_steal_batched = t > best_steal_batched ? t : best_steal_batched;
+        }
+        printf("%8d %13.2f M/s %13.2f M/s %13.2f M/s %13.2f M/s %13.2f M/s\n", workers, best_legacy / 1e6,
+               best_ring / 1e6, best_steal / 1e6, best_ring_batched / 1e6, best_steal_batched / 1e6);
+        delete ring;
+        delete steal;
+        fflush(stdout);
+    }
+    return 0;
+}
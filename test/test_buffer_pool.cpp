@@ -0,0 +1,84 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "buffer_pool.hpp"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// 检查分级取整、块复用以及多线程交叉分配/归还
+
+void test_size_class() {
+    buffer_pool* pool = buffer_pool::get_instance();
+    size_t size = 1;
+    char* a = pool->alloc(size);
+    assert(a && size == buffer_pool::MIN_SIZE);
+
+    size = 3000;
+    char* b = pool->alloc(size);
+    assert(b && size == 4096);
+
+    size = buffer_pool::MAX_SIZE;
+    char* c = pool->alloc(size);
+    assert(c && size == buffer_pool::MAX_SIZE);
+
+    size = buffer_pool::MAX_SIZE + 1;
+    char* d = pool->alloc(size);
+    assert(d == nullptr);
+
+    pool->free(a, buffer_pool::MIN_SIZE);
+    pool->free(b, 4096);
+    pool->free(c, buffer_pool::MAX_SIZE);
+    printf("size class ok\n");
+}
+
+void test_reuse() {
+    buffer_pool* pool = buffer_pool::get_instance();
+    size_t size = 2048;
+    char* a = pool->alloc(size);
+    pool->free(a, size);
+    char* b = pool->alloc(size);
+    assert(a == b);     // 同一线程归还的块应被优先复用
+    pool->free(b, size);
+    printf("reuse ok\n");
+}
+
+static void* churn(void* arg) {
+    buffer_pool* pool = buffer_pool::get_instance();
+    long id = (long)arg;
+    std::vector<char*> held;
+    for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            size_t size = 2048 << (i % 3);
+            char* buf = pool->alloc(size);
+            memset(buf, (int)id, size);
+            held.push_back(buf);
+        }
+        for (size_t i = 0; i < held.size(); ++i) {
+            size_t size = 2048 << (i % 3);
+            assert(held[i][0] == (char)id && held[i][size - 1] == (char)id);
+            pool->free(held[i], size);
+        }
+        held.clear();
+    }
+    return nullptr;
+}
+
+void test_threads() {
+    pthread_t tids[4];
+    for (long i = 0; i < 4; ++i) {
+        pthread_create(&tids[i], nullptr, churn, (void*)(i + 1));
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(tids[i], nullptr);
+    }
+    printf("threads ok\n");
+}
+
+int main() {
+    test_size_class();
+    test_reuse();
+    test_threads();
+    return 0;
+}
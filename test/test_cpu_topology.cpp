@@ -0,0 +1,124 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "cpu_topology.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+// 在临时目录中伪造双路、每路2核4线程的sysfs和网卡中断的procfs, 检查CPU列表解析、
+// 节点归属、绑核顺序(先物理核后超线程, 按节点填满)、进程亲和掩码过滤和网卡中断CPU
+
+static std::string root;
+
+static void write_file(const std::string& path, const char* content) {
+    // 逐级创建目录
+    for (size_t pos = root.size() + 1; (pos = path.find('/', pos)) != std::string::npos; ++pos) {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+    FILE* fp = fopen(path.c_str(), "w");
+    assert(fp);
+    fputs(content, fp);
+    fclose(fp);
+}
+
+static void make_tree() {
+    char tmpl[] = "/tmp/cpu_topology_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    assert(dir);
+    root = dir;
+    const std::string sys = root + "/sys";
+    write_file(sys + "/devices/system/cpu/online", "0-7\n");
+    // cpu0-3为各物理核的第一个超线程, cpu4-7为对应的第二个; 封装0(cpu0,1,4,5)在节点0
+    for (int cpu = 0; cpu < 8; ++cpu) {
+        char dir[128], value[16];
+        snprintf(dir, sizeof(dir), "%s/devices/system/cpu/cpu%d/topology/", sys.c_str(), cpu);
+        snprintf(value, sizeof(value), "%d\n", (cpu % 4) / 2);
+        write_file(std::string(dir) + "physical_package_id", value);
+        snprintf(value, sizeof(value), "%d\n", cpu % 2);
+        write_file(std::string(dir) + "core_id", value);
+    }
+    write_file(sys + "/devices/system/node/node0/cpulist", "0-1,4-5\n");
+    write_file(sys + "/devices/system/node/node1/cpulist", "2-3,6-7\n");
+    write_file(sys + "/devices/system/node/online", "0-1\n");   // 不是nodeN, 应当被忽略
+
+    // 网卡eth0有4个MSI中断, 其中一个未设置生效亲和, 一个与其他中断同CPU
+    const std::string irqs = sys + "/class/net/eth0/device/msi_irqs/";
+    const std::string proc = root + "/proc/irq/";
+    write_file(irqs + "40", "msix\n");
+    write_file(irqs + "41", "msix\n");
+    write_file(irqs + "42", "msix\n");
+    write_file(irqs + "43", "msix\n");
+    write_file(proc + "40/effective_affinity_list", "6\n");
+    write_file(proc + "41/effective_affinity_list", "\n");
+    write_file(proc + "41/smp_affinity_list", "1-3\n");
+    write_file(proc + "42/effective_affinity_list", "6\n");
+    write_file(proc + "43/effective_affinity_list", "3\n");
+}
+
+static void test_parse() {
+    std::vector<int> v = cpu_topology::parse_cpu_list("0-3,8,10-11");
+    int expect[] = {0, 1, 2, 3, 8, 10, 11};
+    assert(v == std::vector<int>(expect, expect + 7));
+    assert(cpu_topology::parse_cpu_list("5") == std::vector<int>(1, 5));
+    assert(cpu_topology::parse_cpu_list("").empty());
+    printf("parse ok\n");
+}
+
+static void test_load() {
+    cpu_set_t all;
+    CPU_ZERO(&all);
+    for (int i = 0; i < 8; ++i)
+        CPU_SET(i, &all);
+    cpu_topology topo;
+    bool ok = topo.load(root + "/sys", &all);
+    assert(ok);
+    assert(topo.cpus().size() == 8 && topo.node_count() == 2);
+    assert(topo.node_of(5) == 0 && topo.node_of(6) == 1);
+    int expect[] = {0, 1, 4, 5, 2, 3, 6, 7};
+    assert(topo.placement() == std::vector<int>(expect, expect + 8));
+
+    int irq_expect[] = {6, 1, 3};
+    assert(topo.nic_irq_cpus("eth0", root + "/proc") == std::vector<int>(irq_expect, irq_expect + 3));
+    assert(topo.nic_irq_cpus("eth1", root + "/proc").empty());
+
+    // 进程只允许在节点1上运行
+    cpu_set_t node1;
+    CPU_ZERO(&node1);
+    CPU_SET(2, &node1);
+    CPU_SET(3, &node1);
+    CPU_SET(6, &node1);
+    CPU_SET(7, &node1);
+    ok = topo.load(root + "/sys", &node1);
+    assert(ok);
+    assert(topo.node_count() == 1);
+    int expect1[] = {2, 3, 6, 7};
+    assert(topo.placement() == std::vector<int>(expect1, expect1 + 4));
+    int irq_expect1[] = {6, 3};
+    assert(topo.nic_irq_cpus("eth0", root + "/proc") == std::vector<int>(irq_expect1, irq_expect1 + 2));
+    printf("load ok\n");
+}
+
+static void test_fallback() {
+    // 读不到sysfs时按可用CPU数退回为单节点
+    cpu_topology topo;
+    bool ok = topo.load(root + "/missing");
+    assert(!ok);
+    assert(!topo.cpus().empty() && topo.node_count() == 1);
+    assert(topo.placement().size() == topo.cpus().size());
+    printf("fallback ok\n");
+}
+
+int main() {
+    make_tree();
+    test_parse();
+    test_load();
+    test_fallback();
+    std::string cmd = "rm -rf " + root;
+    int ret = system(cmd.c_str());
+    assert(ret == 0);
+    return 0;
+}
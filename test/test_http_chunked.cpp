@@ -0,0 +1,96 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "http_chunked.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// 分块请求体按任意切分喂给解码器, 结果与一次解码相同; 输出缓冲区写满时能续上; 检查格式错误和分块头
+
+// 把msg按每次step字节喂入, 输出缓冲区每次最多room字节, 返回解码结果和消耗的总字节数
+static http_chunked::STATUS feed(const std::string& msg, long step, long room, std::string* body, long* consumed) {
+    http_chunked::decoder d;
+    long pos = 0;
+    char out[4096];
+    body->clear();
+    while (pos < (long)msg.size()) {
+        long len = (long)msg.size() - pos < step ? (long)msg.size() - pos : step;
+        long used = 0, produced = 0;
+        http_chunked::STATUS s = d.decode(msg.data() + pos, len, &used, out, room, &produced);
+        body->append(out, produced);
+        pos += used;
+        if (s != http_chunked::CHUNK_MORE) {
+            *consumed = pos;
+            return s;
+        }
+    }
+    *consumed = pos;
+    return http_chunked::CHUNK_MORE;
+}
+
+static void test_decode() {
+    const std::string msg = "5\r\nhello\r\n1;ext=1\r\n \r\nA\r\n0123456789\r\n0\r\nX-Trailer: a\r\n\r\nGET / HTTP/1.1\r\n";
+    const std::string expect = "hello 0123456789";
+    const long end = msg.find("GET");
+    for (long step = 1; step <= (long)msg.size(); ++step) {
+        for (long room = 1; room <= 32; room += 3) {
+            std::string body;
+            long consumed = 0;
+            http_chunked::STATUS st = feed(msg, step, room, &body, &consumed);
+            assert(st == http_chunked::CHUNK_DONE);
+            assert(body == expect && consumed == end);
+        }
+    }
+
+    // 只有行结束符'\n', 没有尾部字段
+    std::string body;
+    long consumed = 0;
+    http_chunked::STATUS st = feed("3\nabc\n0\n\n", 4, 64, &body, &consumed);
+    assert(st == http_chunked::CHUNK_DONE && body == "abc");
+
+    // 不完整时需要更多输入
+    st = feed("4\r\nab", 64, 64, &body, &consumed);
+    assert(st == http_chunked::CHUNK_MORE && body == "ab");
+    printf("decode ok\n");
+}
+
+static void test_bad() {
+    const char* bad[] = {
+        "\r\n",                     // 没有长度
+        "g\r\n",                    // 非16进制
+        "3\r\nabcX",                // 数据后不是CRLF
+        "3\rX",                     // 长度后CR之后不是LF
+        "fffffffffff\r\n",          // 超过分块长度上限
+        "0\r\n\rX",                 // 结尾空行不完整
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        std::string body;
+        long consumed = 0;
+        http_chunked::STATUS st = feed(bad[i], 64, 64, &body, &consumed);
+        assert(st == http_chunked::CHUNK_BAD);
+    }
+    printf("bad ok\n");
+}
+
+static void test_head() {
+    long sizes[] = {0, 1, 15, 16, 255, 4096, 0x7fffffffL};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char buf[32];
+        char* head = buf + http_chunked::HEAD_ROOM;
+        int len = http_chunked::prepend_chunk_head(head, sizes[i]);
+        assert(len <= http_chunked::HEAD_ROOM);
+        char ref[32];
+        snprintf(ref, sizeof(ref), "%lx\r\n", sizes[i]);
+        assert(std::string(head - len, len) == ref);
+    }
+    assert(strlen(http_chunked::LAST_CHUNK) == (size_t)http_chunked::LAST_CHUNK_LEN);
+    printf("head ok\n");
+}
+
+int main() {
+    test_decode();
+    test_bad();
+    test_head();
+    return 0;
+}
@@ -0,0 +1,217 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "http_conn.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+// 不经过socket在进程内驱动http_conn: 生成函数的响应以分块编码发出, 分块长度与数据一致并以0\r\n\r\n结束,
+// 之后同一连接上的长连接请求照常处理; 用户列表页跨多个分块输出全部用户并转义; 生成函数出错时截断并关闭连接
+
+static std::string root;
+
+// close_conn只在描述符有效时释放缓冲区, 连接用一个真实的描述符, 不会被读写
+static void open_conn(http_conn& c, http_conn::config* cfg) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    int fd = open("/dev/null", O_RDWR);
+    assert(fd >= 0);
+    c.init(fd, addr, cfg, 0, -1);
+}
+
+// 准备好的请求喂给连接, 把一批响应全部"写出", 返回写出的字节; keep_alive返回finish_write的结果
+static std::string respond(http_conn& c, const std::string& req, bool* keep_alive) {
+    if (!req.empty()) {
+        int n = c.append_read(req.data(), req.size());
+        assert(n == (int)req.size());
+    }
+    int ret = c.prepare_response();
+    assert(ret == 1);
+    std::string out;
+    for (;;) {
+        long bytes = 0;
+        for (int i = 0; i < c.write_iov_count(); ++i) {
+            const struct iovec& iv = c.write_iov()[i];
+            out.append(static_cast<const char*>(iv.iov_base), iv.iov_len);
+            bytes += iv.iov_len;
+        }
+        // 分块响应每发完一块, advance_write向生成函数要下一块
+        if (c.advance_write(bytes)) {
+            break;
+        }
+    }
+    *keep_alive = c.finish_write();
+    return out;
+}
+
+// 解开分块编码的响应体, 返回解码后的数据; 必须恰好以最后一个分块和空行结束
+static std::string dechunk(const std::string& resp, int* chunks) {
+    size_t pos = resp.find("\r\n\r\n");
+    assert(pos != std::string::npos);
+    std::string head = resp.substr(0, pos + 2);
+    assert(head.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0);
+    assert(head.find("Transfer-Encoding:chunked\r\n") != std::string::npos);
+    assert(head.find("Content-Length") == std::string::npos);
+    pos += 4;
+    std::string body;
+    *chunks = 0;
+    for (;;) {
+        size_t eol = resp.find("\r\n", pos);
+        assert(eol != std::string::npos);
+        char* end;
+        long len = strtol(resp.c_str() + pos, &end, 16);
+        assert(end == resp.c_str() + eol && len >= 0);
+        pos = eol + 2;
+        if (len == 0) {
+            break;
+        }
+        assert(pos + len + 2 <= resp.size() && resp.compare(pos + len, 2, "\r\n") == 0);
+        body.append(resp, pos, len);
+        pos += len + 2;
+        ++*chunks;
+    }
+    // 最后一个分块之后只有结束空行, 没有尾部字段
+    assert(pos + 2 == resp.size() && resp.compare(pos - 3, 5, "0\r\n\r\n") == 0);
+    return body;
+}
+
+// 按固定规律生成total字节, 每次只给出一部分, 覆盖少于一块和正好写满一块
+static http_conn::producer counting(long total) {
+    long sent = 0;
+    int call = 0;
+    return [total, sent, call](char* buf, int size) mutable -> int {
+        int n = ++call % 3 == 0 ? size : 1000 + call;
+        if (n > total - sent) {
+            n = total - sent;
+        }
+        for (int i = 0; i < n; ++i) {
+            buf[i] = 'a' + (sent + i) % 26;
+        }
+        sent += n;
+        return n;
+    };
+}
+
+static std::string counting_body(long total) {
+    std::string s;
+    for (long i = 0; i < total; ++i) {
+        s += 'a' + i % 26;
+    }
+    return s;
+}
+
+static void test_stream(http_conn::config* cfg) {
+    http_conn c;
+    open_conn(c, cfg);
+    const std::string stream_req = "GET /stream.txt HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+    const std::string file_req = "GET /index.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+
+    bool keep_alive;
+    int chunks;
+    std::string resp = respond(c, stream_req, &keep_alive);
+    assert(keep_alive);
+    assert(resp.find("Content-Type:text/plain\r\n") != std::string::npos);
+    assert(dechunk(resp, &chunks) == counting_body(100000) && chunks > 6);
+
+    // 分块响应结束后同一连接上的下一个请求
+    resp = respond(c, file_req, &keep_alive);
+    assert(keep_alive);
+    assert(resp.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0);
+    assert(resp.find("Content-Length:6\r\n") != std::string::npos);
+    assert(resp.compare(resp.size() - 10, 10, "\r\n\r\nhello\n") == 0);
+
+    // 两个请求一起到达: 分块响应必须是本批最后一个, 后面的请求在它发完后处理
+    resp = respond(c, stream_req + file_req, &keep_alive);
+    assert(keep_alive && c.has_pending_input());
+    assert(dechunk(resp, &chunks) == counting_body(100000));
+    resp = respond(c, "", &keep_alive);
+    assert(keep_alive && !c.has_pending_input());
+    assert(resp.compare(resp.size() - 10, 10, "\r\n\r\nhello\n") == 0);
+
+    // HEAD只有响应头
+    resp = respond(c, "HEAD /stream.txt HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n", &keep_alive);
+    assert(keep_alive);
+    assert(resp.find("Transfer-Encoding:chunked\r\n") != std::string::npos);
+    assert(resp.compare(resp.size() - 4, 4, "\r\n\r\n") == 0 && resp.find("\r\n\r\n") == resp.size() - 4);
+
+    // 生成函数出错: 没有最后一个分块, 连接不再保持
+    resp = respond(c, "GET /broken.txt HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n", &keep_alive);
+    assert(!keep_alive);
+    assert(resp.find("0\r\n\r\n") == std::string::npos);
+    c.close_conn();
+    printf("stream ok\n");
+}
+
+static void test_user_list(http_conn::config* cfg) {
+    for (int i = 0; i < 3000; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "user%05d", i);
+        cfg->users[name] = "pw";
+    }
+    cfg->users["<b>&\"'"] = "pw";
+    http_conn c;
+    open_conn(c, cfg);
+
+    bool keep_alive;
+    int chunks;
+    std::string resp = respond(c, "GET /users.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n", &keep_alive);
+    assert(keep_alive);
+    assert(resp.find("Content-Type:text/html\r\n") != std::string::npos);
+    std::string body = dechunk(resp, &chunks);
+    assert(chunks > 1);
+    assert(body.compare(0, 15, "<!DOCTYPE html>") == 0);
+    assert(body.compare(body.size() - 21, 21, "</ul>\n</body></html>\n") == 0);
+    // 转义后的用户名排在最前, 其余按名字顺序各出现一次, 密码不出现
+    size_t pos = body.find("<li>&lt;b&gt;&amp;&quot;&#39;</li>\n");
+    assert(pos != std::string::npos);
+    for (int i = 0; i < 3000; ++i) {
+        char row[48];
+        snprintf(row, sizeof(row), "<li>user%05d</li>\n", i);
+        size_t next = body.find(row);
+        assert(next != std::string::npos && next > pos);
+        pos = next;
+    }
+    assert(body.find("pw") == std::string::npos);
+
+    resp = respond(c, "GET /index.html HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n", &keep_alive);
+    assert(keep_alive && resp.compare(resp.size() - 10, 10, "\r\n\r\nhello\n") == 0);
+    c.close_conn();
+    printf("user list ok\n");
+}
+
+int main() {
+    char tmpl[] = "/tmp/test_http_conn_XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    assert(dir);
+    root = dir;
+    std::string index = root + "/index.html";
+    FILE* fp = fopen(index.c_str(), "w");
+    assert(fp);
+    fputs("hello\n", fp);
+    fclose(fp);
+
+    http_conn::config cfg;
+    cfg.doc_root = root;
+    cfg.close_log = 1;
+    cfg.handlers["/stream.txt"] = [](http_conn&) { return counting(100000); };
+    cfg.handlers["/broken.txt"] = [](http_conn&) {
+        int call = 0;
+        return http_conn::producer([call](char* buf, int size) mutable -> int {
+            memset(buf, 'x', 100);
+            return ++call < 3 ? 100 : -1;
+        });
+    };
+    http_conn::register_handlers(&cfg);
+
+    test_stream(&cfg);
+    test_user_list(&cfg);
+
+    unlink(index.c_str());
+    int ret = rmdir(root.c_str());
+    assert(ret == 0);
+    return 0;
+}
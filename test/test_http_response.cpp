@@ -0,0 +1,93 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "http_response.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// 检查整数转换、固定响应的Content-Length、MIME完美哈希和HTTP日期
+
+static void test_itoa() {
+    char buf[32];
+    unsigned long long values[] = {0, 7, 10, 99, 100, 123456789, 18446744073709551615ULL};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        char ref[32];
+        int len = http_response::itoa(values[i], buf);
+        int ref_len = snprintf(ref, sizeof(ref), "%llu", values[i]);
+        assert(len == ref_len && memcmp(buf, ref, len) == 0);
+    }
+    int len = http_response::format_content_range(buf, 0, 1023, 300000);
+    assert(std::string(buf, len) == "bytes 0-1023/300000");
+    printf("itoa ok\n");
+}
+
+static void test_canned() {
+    int status[] = {200, 400, 403, 404, 416, 500};
+    for (size_t i = 0; i < sizeof(status) / sizeof(status[0]); ++i) {
+        const http_response::canned& r = http_response::canned_response(status[i]);
+        std::string head(r.head.data, r.head.len);
+        char line[16];
+        snprintf(line, sizeof(line), " %d ", status[i]);
+        assert(head.compare(0, 9, "HTTP/1.1 ") == 0 && head.find(line) == 8);
+        size_t pos = head.find("Content-Length:");
+        assert(pos != std::string::npos && atoi(head.c_str() + pos + 15) == r.body.len);
+        assert(head.compare(head.size() - 2, 2, "\r\n") == 0);
+    }
+    // 未知状态码退回500
+    assert(&http_response::canned_response(418) == &http_response::canned_response(500));
+    assert(http_response::status_line(304).len == (int)strlen("HTTP/1.1 304 Not Modified\r\n"));
+    printf("canned ok\n");
+}
+
+static void test_mime() {
+    struct {
+        const char* path;
+        const char* type;
+    } cases[] = {
+        {"/root/index.html", "text/html"},
+        {"/a/b/STYLE.CSS", "text/css"},
+        {"x.js", "application/javascript"},
+        {"x.mjs", "application/javascript"},
+        {"x.json", "application/json"},
+        {"x.jpg", "image/jpeg"},
+        {"x.jpeg", "image/jpeg"},
+        {"x.webp", "image/webp"},
+        {"x.mp4", "video/mp4"},
+        {"x.woff", "font/woff"},
+        {"x.woff2", "font/woff2"},
+        {"x.gz", "application/gzip"},
+        {"x.wasm", "application/wasm"},
+        {"x.unknownext", "application/octet-stream"},
+        {"x.", "application/octet-stream"},
+        {"/dir.html/file", "application/octet-stream"},
+        {"noext", "application/octet-stream"},
+        {"x.htmlx", "application/octet-stream"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const http_response::text& t = http_response::mime_type(cases[i].path, strlen(cases[i].path));
+        assert(std::string(t.data, t.len) == cases[i].type);
+    }
+    printf("mime ok\n");
+}
+
+static void test_date() {
+    char buf[64];
+    int len = http_response::format_http_date(784111777, buf, sizeof(buf));
+    assert(std::string(buf, len) == "Sun, 06 Nov 1994 08:49:37 GMT");
+    assert(http_response::parse_http_date(buf) == 784111777);
+    assert(http_response::parse_http_date("yesterday") == -1);
+
+    const http_response::text& date = http_response::date_header();
+    assert(date.len == 5 + 29 + 2 && memcmp(date.data, "Date:", 5) == 0);
+    printf("date ok\n");
+}
+
+int main() {
+    test_itoa();
+    test_canned();
+    test_mime();
+    test_date();
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "http_scan.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+// 各向量实现与逐字节结果逐一对比, 覆盖所有起始偏移和长度; 检查完美哈希能识别全部已知请求头
+
+static size_t ref_eol(const char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        if (p[i] == '\r' || p[i] == '\n')
+            return i;
+    return len;
+}
+
+static size_t ref_colon(const char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        if (p[i] == ':')
+            return i;
+    return len;
+}
+
+static void check_impl(const char* name) {
+    if (!http_scan::select(name)) {
+        printf("%s not supported, skip\n", name);
+        return;
+    }
+    char buf[256];
+    srand(1);
+    for (int round = 0; round < 200; ++round) {
+        // 稀疏放置分隔符, 保证多数位置需要跨越整个向量
+        for (size_t i = 0; i < sizeof(buf); ++i) {
+            int r = rand() % 97;
+            buf[i] = r == 0 ? '\r' : r == 1 ? '\n' : r == 2 ? ':' : (char)('a' + r % 26);
+        }
+        for (size_t off = 0; off < 40; ++off) {
+            for (size_t len = 0; off + len <= sizeof(buf); len += 7) {
+                assert(http_scan::find_eol(buf + off, len) == ref_eol(buf + off, len));
+                assert(http_scan::find_colon(buf + off, len) == ref_colon(buf + off, len));
+            }
+        }
+    }
+    printf("%s ok\n", http_scan::impl());
+}
+
+static void test_lookup() {
+    for (int id = 1; id < http_scan::HDR_COUNT; ++id) {
+        const char* name = http_scan::header_name((http_scan::HEADER_ID)id);
+        size_t len = strlen(name);
+        assert(http_scan::lookup_header(name, len) == id);
+
+        char lower[64];
+        for (size_t i = 0; i <= len; ++i)
+            lower[i] = tolower(name[i]);
+        assert(http_scan::lookup_header(lower, len) == id);
+    }
+    assert(http_scan::lookup_header("X-Forwarded-For", 15) == http_scan::HDR_UNKNOWN);
+    assert(http_scan::lookup_header("Hos", 3) == http_scan::HDR_UNKNOWN);
+    assert(http_scan::lookup_header("Hostx", 5) == http_scan::HDR_UNKNOWN);
+    assert(http_scan::lookup_header("", 0) == http_scan::HDR_UNKNOWN);
+    printf("lookup ok\n");
+}
+
+static void test_length() {
+    assert(http_scan::parse_length("0", 1, 65536) == 0);
+    assert(http_scan::parse_length("1234", 4, 65536) == 1234);
+    assert(http_scan::parse_length("65536", 5, 65536) == 65536);
+    assert(http_scan::parse_length("65537", 5, 65536) == -1);
+    assert(http_scan::parse_length("-5", 2, 65536) == -1);
+    assert(http_scan::parse_length("+5", 2, 65536) == -1);
+    assert(http_scan::parse_length("9223372036854775807", 19, 65536) == -1);
+    assert(http_scan::parse_length("99999999999999999999999", 23, 65536) == -1);
+    assert(http_scan::parse_length("12a", 3, 65536) == -1);
+    assert(http_scan::parse_length("1 2", 3, 65536) == -1);
+    assert(http_scan::parse_length("", 0, 65536) == -1);
+    printf("length ok\n");
+}
+
+int main() {
+    printf("default impl: %s\n", http_scan::impl());
+    check_impl("scalar");
+    check_impl("sse4.2");
+    check_impl("avx2");
+    test_lookup();
+    test_length();
+    return 0;
+}
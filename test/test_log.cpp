@@ -1,52 +1,134 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
 #include "log.hpp"
-#include <unistd.h> // for sleep
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 
+// 在临时目录中检查: 异步模式下多个线程各自写入的日志全部落盘且每个线程内保持顺序, 线程退出后缓冲区被回收;
+// 同步模式按行数切分文件; 超长的行被截断; 关闭日志时不写入
 
-// 创建包含日志开关的类
+static std::string dir;
+
+// 创建包含日志开关的类, LOG_*宏读取调用者的close_log_
 class ClassLog {
-private:
-    int close_log_=0; // 日志开关
 public:
-    void test_basic_logging() {
-        // 初始化日志，异步模式（max_queue_size > 0）
-        Log::get_instance()->init("testlog", 0, 1000, 8192, 5);
-
-        // LOG_DEBUG("Debug message: %d", 1);
-        // LOG_INFO("Info message: %s", "info test");
-        // LOG_WARN("Warning message");
-        // LOG_ERROR("Error message %.2f", 3.14);
-        // LOG_FATAL("Fatal error");
-        for (int i = 0; i < 100; ++i) {
-            LOG_INFO("Sync log test %d", i);
-        }
-
-        // 给异步线程一些时间来写入日志
-        sleep(1);
-    }
+    int close_log_ = 0; // 日志开关
+    void info(int thread, int i) { LOG_INFO("thread %d line %d", thread, i); }
+    void error(const char* s) { LOG_ERROR("%s", s); }
+};
+
+static std::string file_of(const char* name, int index) {
+    time_t t = time(nullptr);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char path[512];
+    if (index > 0)
+        snprintf(path, sizeof(path), "%s/%d_%02d_%02d_%s.%d", dir.c_str(), tm.tm_year + 1900, tm.tm_mon + 1,
+                 tm.tm_mday, name, index);
+    else
+        snprintf(path, sizeof(path), "%s/%d_%02d_%02d_%s", dir.c_str(), tm.tm_year + 1900, tm.tm_mon + 1,
+                 tm.tm_mday, name);
+    return path;
+}
 
-    void test_sync_logging() {
-        // 同步模式（max_queue_size == 0）
-        Log::get_instance()->init("sync_testlog", 0, 1000, 8192, 0);
+static std::vector<std::string> read_lines(const std::string& path) {
+    std::vector<std::string> lines;
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp)
+        return lines;
+    char buf[16384];
+    while (fgets(buf, sizeof(buf), fp))
+        lines.push_back(buf);
+    fclose(fp);
+    return lines;
+}
 
-        for (int i = 0; i < 10; ++i) {
-            LOG_INFO("Sync log test %d", i);
-        }
-    }
+static const int THREADS = 4;
+static const int LINES = 300;   // 每个线程写入的行数, 远小于一个环形缓冲区, 不会丢弃
 
-    void test_disable_logging() {
-        // 关闭日志（close_log=1）
-        Log::get_instance()->init("disabledlog", 1, 1000, 8192,0);
+static void* writer(void* arg) {
+    ClassLog log;
+    int id = (int)(long)arg;
+    for (int i = 0; i < LINES; ++i)
+        log.info(id, i);
+    return nullptr;
+}
 
-        LOG_INFO("This should not appear in the log.");
+static void test_async() {
+    std::string name = dir + "/async_log";
+    bool ok = Log::get_instance()->init(name.c_str(), 0, 1000000, 256, 800);
+    assert(ok);
+    pthread_t threads[THREADS];
+    for (long t = 0; t < THREADS; ++t) {
+        int ret = pthread_create(&threads[t], nullptr, writer, (void*)t);
+        assert(ret == 0);
     }
-};
+    for (int t = 0; t < THREADS; ++t)
+        pthread_join(threads[t], nullptr);
+    // 等刷盘线程按周期写出并回收已退出线程的缓冲区, 再主动刷一次
+    usleep(3 * Log::FLUSH_INTERVAL_MS * 1000);
+    Log::get_instance()->flush();
+
+    std::vector<std::string> lines = read_lines(file_of("async_log", 0));
+    assert(lines.size() == (size_t)THREADS * LINES);
+    int next[THREADS] = {0};
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const char* p = strstr(lines[i].c_str(), "[info]: thread ");
+        assert(p);
+        int t, n;
+        int fields = sscanf(p, "[info]: thread %d line %d", &t, &n);
+        assert(fields == 2);
+        assert(t >= 0 && t < THREADS && n == next[t]);
+        ++next[t];
+    }
+    printf("async ok\n");
+}
 
+static void test_split_and_truncate() {
+    // 同步模式, 每100行一个文件, 第100行起写入.1
+    std::string name = dir + "/sync_log";
+    bool ok = Log::get_instance()->init(name.c_str(), 0, 100, 64, 0);
+    assert(ok);
+    ClassLog log;
+    for (int i = 1; i < 150; ++i)
+        log.info(0, i);
+    assert(read_lines(file_of("sync_log", 0)).size() == 99);
+    assert(read_lines(file_of("sync_log", 1)).size() == 50);
 
+    std::string big(1000, 'x');
+    log.error(big.c_str());
+    std::vector<std::string> lines = read_lines(file_of("sync_log", 1));
+    assert(lines.size() == 51 && lines.back().size() == 63 && lines.back()[62] == '\n');
+    printf("split ok\n");
+}
+
+static void test_disabled() {
+    std::string name = dir + "/disabled_log";
+    bool ok = Log::get_instance()->init(name.c_str(), 1, 1000, 8192, 0);
+    assert(ok);
+    ClassLog log;
+    log.info(0, 0);
+    assert(read_lines(file_of("disabled_log", 0)).empty());
+    printf("disabled ok\n");
+}
 
 int main() {
-    ClassLog log_test;
-    log_test.test_basic_logging();
-    log_test.test_sync_logging();
-    log_test.test_disable_logging();
+    char tmpl[] = "/tmp/test_log_XXXXXX";
+    char* path = mkdtemp(tmpl);
+    assert(path);
+    dir = path;
+    test_async();
+    test_split_and_truncate();
+    test_disabled();
+    std::string cmd = "rm -rf " + dir;
+    int ret = system(cmd.c_str());
+    assert(ret == 0);
     return 0;
 }
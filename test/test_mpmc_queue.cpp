@@ -0,0 +1,177 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "mpmc_queue.hpp"
+#include "locker.hpp"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+
+// 检查容量取整、满/空边界, 以及多生产者多消费者下每个元素恰好被取出一次; 一半消费者批量取出,
+// 消费者取空后在parker上休眠
+
+void test_bounds() {
+    mpmc_queue<long> q(5);
+    assert(q.capacity() == 8);
+    long v;
+    bool ok = q.try_pop(v);
+    assert(!ok);
+    for (long i = 0; i < 8; ++i) {
+        ok = q.try_push(i);
+        assert(ok);
+    }
+    ok = q.try_push(8);
+    assert(!ok);
+    for (long i = 0; i < 8; ++i) {
+        ok = q.try_pop(v);
+        assert(ok && v == i);
+    }
+    ok = q.try_pop(v);
+    assert(!ok);
+    // 绕环多圈
+    for (long i = 0; i < 100; ++i) {
+        ok = q.try_push(i);
+        assert(ok);
+        ok = q.try_pop(v);
+        assert(ok && v == i);
+    }
+    printf("bounds ok\n");
+}
+
+void test_bulk() {
+    mpmc_queue<long> q(8);
+    long out[16];
+    size_t n = q.try_pop_bulk(out, 16);
+    assert(n == 0);
+    bool ok;
+    for (long i = 0; i < 5; ++i) {
+        ok = q.try_push(i);
+        assert(ok);
+    }
+    n = q.try_pop_bulk(out, 0);
+    assert(n == 0);
+    // 最多取max个, 按入队顺序
+    n = q.try_pop_bulk(out, 3);
+    assert(n == 3 && out[0] == 0 && out[2] == 2);
+    n = q.try_pop_bulk(out, 16);
+    assert(n == 2 && out[0] == 3 && out[1] == 4);
+    n = q.try_pop_bulk(out, 16);
+    assert(n == 0);
+    // 绕环多圈, 与单个取出交替
+    long v;
+    for (long i = 0; i < 100; ++i) {
+        for (long j = 0; j < 8; ++j) {
+            ok = q.try_push(i * 8 + j);
+            assert(ok);
+        }
+        ok = q.try_push(0);
+        assert(!ok);
+        ok = q.try_pop(v);
+        assert(ok && v == i * 8);
+        n = q.try_pop_bulk(out, 16);
+        assert(n == 7);
+        for (long j = 0; j < 7; ++j) {
+            assert(out[j] == i * 8 + j + 1);
+        }
+    }
+    printf("bulk ok\n");
+}
+
+static const int PRODUCERS = 4;
+static const int CONSUMERS = 4;
+static const long PER_PRODUCER = 200000;
+
+struct shared_state {
+    mpmc_queue<long>* queue;
+    parker* idle;
+    std::atomic<long> consumed;
+    std::vector<std::atomic<char>>* seen;
+};
+
+static void* produce(void* arg) {
+    shared_state* st = static_cast<shared_state*>(arg);
+    static std::atomic<int> next_id(0);
+    long id = next_id++;
+    for (long i = 0; i < PER_PRODUCER; ++i) {
+        long v = id * PER_PRODUCER + i;
+        while (!st->queue->try_push(v)) {
+            cpu_relax();
+        }
+        st->idle->notify_one();
+    }
+    return nullptr;
+}
+
+// 取出若干元素并标记, 返回取出的个数
+static size_t pop_some(shared_state* st, bool bulk) {
+    long v[8];
+    size_t n = bulk ? st->queue->try_pop_bulk(v, 8) : st->queue->try_pop(v[0]);
+    for (size_t i = 0; i < n; ++i) {
+        char was = (*st->seen)[v[i]].exchange(1);
+        assert(was == 0);
+    }
+    st->consumed += n;
+    return n;
+}
+
+static void* consume(void* arg) {
+    shared_state* st = static_cast<shared_state*>(arg);
+    static std::atomic<int> next_id(0);
+    bool bulk = next_id++ % 2 == 1;
+    const long total = PRODUCERS * PER_PRODUCER;
+    while (st->consumed.load() < total) {
+        if (pop_some(st, bulk)) {
+            continue;
+        }
+        uint32_t key = st->idle->prepare_wait();
+        if (pop_some(st, bulk)) {
+            st->idle->cancel_wait();
+            continue;
+        }
+        if (st->consumed.load() >= total) {
+            st->idle->cancel_wait();
+            break;
+        }
+        st->idle->wait(key);
+    }
+    st->idle->notify_all();
+    return nullptr;
+}
+
+void test_threads() {
+    mpmc_queue<long> q(64);     // 容量远小于元素总数, 覆盖队列满时的重试
+    parker idle;
+    std::vector<std::atomic<char>> seen(PRODUCERS * PER_PRODUCER);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        seen[i].store(0);
+    }
+    shared_state st;
+    st.queue = &q;
+    st.idle = &idle;
+    st.consumed.store(0);
+    st.seen = &seen;
+
+    pthread_t tids[PRODUCERS + CONSUMERS];
+    for (int i = 0; i < CONSUMERS; ++i) {
+        pthread_create(&tids[i], nullptr, consume, &st);
+    }
+    for (int i = 0; i < PRODUCERS; ++i) {
+        pthread_create(&tids[CONSUMERS + i], nullptr, produce, &st);
+    }
+    for (int i = 0; i < PRODUCERS + CONSUMERS; ++i) {
+        pthread_join(tids[i], nullptr);
+    }
+    assert(st.consumed.load() == PRODUCERS * PER_PRODUCER);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        assert(seen[i].load() == 1);
+    }
+    printf("threads ok\n");
+}
+
+int main() {
+    test_bounds();
+    test_bulk();
+    test_threads();
+    return 0;
+}
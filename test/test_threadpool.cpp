@@ -0,0 +1,259 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "threadpool.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+
+// 线程池的伸缩和关闭: 所有线程都忙且有积压时线程数增长到上限, 空闲超时后回落到下限;
+// shutdown处理完已入队的任务后回收线程, 之后不再接收任务; 开启排队期限时等待过久的任务被丢弃;
+// 需要数据库的任务从快车道转到数据库车道, 数据库车道阻塞时快车道照常处理; 处理完、丢弃和转交车道的任务
+// 都恰好交还一次(mark_returned), 转交时不交还. 共享队列和工作窃取两种模式都检查.
+// 数据库连接池未初始化, connectionRAII取不到连接直接返回
+
+static std::atomic<long> done(0);
+static std::atomic<int> gate(1);    // 为1时任务阻塞, 模拟等待数据库
+static std::atomic<long> shed(0);
+static std::atomic<int> db_gate(0); // 为1时需要数据库的任务阻塞, 模拟慢查询
+static std::atomic<long> db_done(0);
+
+struct task {
+    int state_;
+    std::atomic<int> improv;
+    std::atomic<int> timer_flag;
+    uint64_t enqueue_ms_;
+    MYSQL* mysql_;
+    bool db_;
+    std::atomic<int> returned;
+
+    task() : state_(0), improv(0), timer_flag(0), enqueue_ms_(0), mysql_(nullptr), db_(false), returned(0) {}
+    bool read_once() { return true; }
+    bool write() { return true; }
+    bool has_pending_input() const { return false; }
+    bool needs_db() const { return db_; }
+    void shed() { ::shed.fetch_add(1); }
+    void request_close() {}
+    void mark_returned() { returned.fetch_add(1); }
+    void process() {
+        while (gate.load() || (db_ && db_gate.load())) {
+            usleep(100);
+        }
+        if (db_) {
+            db_done.fetch_add(1);
+        }
+        done.fetch_add(1);
+    }
+};
+
+// 每个任务恰好交还一次
+static bool all_returned_once(task* tasks, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (tasks[i].returned.load() != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void reset_returned(task* tasks, int n) {
+    for (int i = 0; i < n; ++i) {
+        tasks[i].returned.store(0);
+    }
+}
+
+static void sleep_ms(int ms) {
+    usleep(ms * 1000);
+}
+
+// 等待cond成立, 最多timeout_ms毫秒
+template <typename F>
+static bool wait_for(F cond, int timeout_ms) {
+    for (int i = 0; i < timeout_ms; i += 10) {
+        if (cond()) {
+            return true;
+        }
+        sleep_ms(10);
+    }
+    return cond();
+}
+
+static void test_elastic(bool work_stealing) {
+    static task tasks[64];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+    threadpool<task>* pool = new threadpool<task>(0, conn_pool, 4, 1000, work_stealing, 1, 200);
+    assert(pool->live_threads() == 1);
+
+    bool ok;
+    done.store(0);
+    gate.store(1);
+    for (int i = 0; i < 64; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+        sleep_ms(1);    // 让被唤醒的线程先取走任务
+    }
+    ok = wait_for([&] { return pool->live_threads() == 4; }, 2000);
+    assert(ok);
+
+    gate.store(0);
+    ok = wait_for([] { return done.load() == 64; }, 5000);
+    assert(ok);
+    // 空闲超过200ms的线程退出, 保留下限
+    ok = wait_for([&] { return pool->live_threads() == 1; }, 5000);
+    assert(ok);
+
+    // 回收后仍能增长
+    gate.store(1);
+    for (int i = 0; i < 64; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+        sleep_ms(1);
+    }
+    ok = wait_for([&] { return pool->live_threads() > 1; }, 2000);
+    assert(ok);
+    gate.store(0);
+    delete pool;
+    assert(done.load() == 128);
+    printf("elastic%s ok\n", work_stealing ? " stealing" : "");
+}
+
+static void test_drain(bool work_stealing) {
+    const int n = 5000;
+    static task tasks[n];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+    threadpool<task>* pool = new threadpool<task>(0, conn_pool, 4, n, work_stealing);
+    assert(pool->live_threads() == 4);
+
+    bool ok;
+    // 任务先阻塞, 关闭时队列中还积压着大部分任务
+    done.store(0);
+    gate.store(1);
+    for (int i = 0; i < n; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+    }
+    gate.store(0);
+    pool->shutdown();
+    assert(done.load() == n);
+    assert(pool->live_threads() == 0);
+    ok = pool->append_p(&tasks[0]);
+    assert(!ok);
+    pool->shutdown();
+    delete pool;
+    printf("drain%s ok\n", work_stealing ? " stealing" : "");
+}
+
+static void test_batched(bool work_stealing) {
+    // 批量投递后只在flush时唤醒, 所有任务都被处理; 队列容量小于投递数, 满时先flush再重试
+    const int n = 20000;
+    static task tasks[n];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+    threadpool<task>* pool = new threadpool<task>(0, conn_pool, 4, 256, work_stealing);
+    done.store(0);
+    gate.store(0);
+    for (int i = 0; i < n; ++i) {
+        while (!pool->append_p_batched(&tasks[i])) {
+            pool->flush();
+            sched_yield();
+        }
+        if (i % 64 == 63) {
+            pool->flush();
+        }
+    }
+    pool->flush();
+    bool ok = wait_for([] { return done.load() == n; }, 5000);
+    assert(ok);
+    delete pool;
+    printf("batched%s ok\n", work_stealing ? " stealing" : "");
+}
+
+static void test_deadline(bool work_stealing) {
+    // 单个工作线程被第一个任务阻塞, 其余任务排队超过50ms后被丢弃, 之后新投递的任务照常处理
+    const int n = 32;
+    static task tasks[2 * n];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+    threadpool<task>* pool = new threadpool<task>(0, conn_pool, 1, 1000, work_stealing);
+    pool->set_queue_deadline(50);
+    reset_returned(tasks, 2 * n);
+    done.store(0);
+    shed.store(0);
+    gate.store(1);
+    bool ok;
+    for (int i = 0; i < n; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+    }
+    sleep_ms(200);
+    gate.store(0);
+    ok = wait_for([] { return done.load() + shed.load() == n; }, 5000);
+    assert(ok);
+    assert(done.load() >= 1 && shed.load() >= n - 8);
+    assert(pool->shed_count() == shed.load());
+
+    for (int i = n; i < 2 * n; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+        sleep_ms(1);
+    }
+    long dropped = shed.load();
+    delete pool;
+    assert(shed.load() == dropped && done.load() + dropped == 2 * n);
+    assert(all_returned_once(tasks, 2 * n));
+    printf("deadline%s ok\n", work_stealing ? " stealing" : "");
+}
+
+static void test_lanes(bool work_stealing) {
+    // 快车道不带连接池, 需要数据库的任务转给数据库车道; 数据库车道全部阻塞时快车道的任务照常完成
+    const int n = 1000, db_n = 8;
+    static task tasks[n], db_tasks[db_n];
+    connection_pool* conn_pool = connection_pool::GetInstance();
+    threadpool<task>* db_lane = new threadpool<task>(0, conn_pool, 2, 100);
+    threadpool<task>* pool = new threadpool<task>(0, nullptr, 4, n, work_stealing);
+    pool->set_db_lane(db_lane);
+    reset_returned(tasks, n);
+    reset_returned(db_tasks, db_n);
+    done.store(0);
+    db_done.store(0);
+    gate.store(0);
+    db_gate.store(1);
+    bool ok;
+    for (int i = 0; i < db_n; ++i) {
+        db_tasks[i].db_ = true;
+        ok = pool->append_p(&db_tasks[i]);
+        assert(ok);
+    }
+    for (int i = 0; i < n; ++i) {
+        ok = pool->append_p(&tasks[i]);
+        assert(ok);
+    }
+    ok = wait_for([] { return done.load() == n; }, 5000);
+    assert(ok);
+    assert(db_done.load() == 0);
+    // 转交数据库车道的任务在那里处理完之前不交还
+    for (int i = 0; i < db_n; ++i) {
+        assert(db_tasks[i].returned.load() == 0);
+    }
+
+    db_gate.store(0);
+    ok = wait_for([] { return db_done.load() == db_n; }, 5000);
+    assert(ok);
+    delete pool;
+    delete db_lane;
+    assert(done.load() == n + db_n);
+    assert(all_returned_once(tasks, n) && all_returned_once(db_tasks, db_n));
+    printf("lanes%s ok\n", work_stealing ? " stealing" : "");
+}
+
+int main() {
+    test_drain(false);
+    test_drain(true);
+    test_batched(false);
+    test_batched(true);
+    test_deadline(false);
+    test_deadline(true);
+    test_lanes(false);
+    test_lanes(true);
+    test_elastic(false);
+    test_elastic(true);
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "timer_wheel.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+
+// 以模拟时间推进时间轮, 检查到期顺序、刷新、删除和跨层级联
+
+static std::vector<int> fired;
+
+static void run_until(timer_wheel& w, uint64_t from, uint64_t to, uint64_t step) {
+    for (uint64_t t = from; t <= to; t += step) {
+        w.tick(t, [](int id) { fired.push_back(id); });
+    }
+}
+
+void test_basic_expire() {
+    uint64_t base = timer_wheel::now_ms();
+    timer_wheel w(16, 10);
+    fired.clear();
+    w.add(1, base + 50);
+    w.add(2, base + 20);
+    w.add(3, base + 1000);
+    assert(w.size() == 3);
+
+    run_until(w, base, base + 100, 10);
+    assert(fired.size() == 2 && fired[0] == 2 && fired[1] == 1);
+    assert(w.contains(3) && !w.contains(1));
+    printf("basic expire ok\n");
+}
+
+void test_adjust_and_remove() {
+    uint64_t base = timer_wheel::now_ms();
+    timer_wheel w(16, 10);
+    fired.clear();
+    w.add(1, base + 50);
+    w.add(2, base + 50);
+    w.adjust(1, base + 300);    // 刷新后不应在50ms到期
+    w.remove(2);
+
+    run_until(w, base, base + 200, 10);
+    assert(fired.empty());
+    run_until(w, base + 200, base + 320, 10);
+    assert(fired.size() == 1 && fired[0] == 1);
+    assert(w.size() == 0);
+    printf("adjust and remove ok\n");
+}
+
+void test_cascade() {
+    uint64_t base = timer_wheel::now_ms();
+    timer_wheel w(16, 1);
+    fired.clear();
+    // 分别落在第1、2层
+    w.add(4, base + 5000);
+    w.add(5, base + 300000);
+
+    run_until(w, base, base + 4990, 10);
+    assert(fired.empty());
+    run_until(w, base + 5000, base + 5010, 1);
+    assert(fired.size() == 1 && fired[0] == 4);
+
+    int timeout = w.next_timeout(base + 5010);
+    assert(timeout > 0 && timeout <= 300000);
+    run_until(w, base + 5010, base + 299990, 97);
+    assert(fired.size() == 1);
+    run_until(w, base + 299990, base + 300010, 1);
+    assert(fired.size() == 2 && fired[1] == 5);
+    assert(w.next_timeout(base + 300010) == -1);
+    printf("cascade ok\n");
+}
+
+void test_next_timeout() {
+    uint64_t base = timer_wheel::now_ms();
+    timer_wheel w(16, 10);
+    assert(w.next_timeout(base) == -1);
+    w.add(7, base + 200);
+    int timeout = w.next_timeout(base);
+    assert(timeout >= 0 && timeout <= 210);
+    printf("next timeout ok\n");
+}
+
+int main() {
+    test_basic_expire();
+    test_adjust_and_remove();
+    test_cascade();
+    test_next_timeout();
+    return 0;
+}
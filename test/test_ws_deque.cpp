@@ -0,0 +1,124 @@
+// Release构建定义了NDEBUG, 取消它让断言照常检查
+#undef NDEBUG
+#include "ws_deque.hpp"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+
+// 检查所有者端后进先出、窃取端先进先出、满/空边界, 以及所有者边放边取、多个线程同时窃取时每个元素恰好被取出一次
+
+void test_bounds() {
+    ws_deque<long> d(5);
+    assert(d.capacity() == 8);
+    long v;
+    bool ok = d.pop(v) || d.steal(v);
+    assert(!ok);
+    for (long i = 0; i < 8; ++i) {
+        ok = d.push(i);
+        assert(ok);
+    }
+    ok = d.push(8);
+    assert(!ok);
+    assert(d.size_approx() == 8);
+    // 所有者从底部取, 窃取者从顶部取
+    ok = d.pop(v);
+    assert(ok && v == 7);
+    ok = d.steal(v);
+    assert(ok && v == 0);
+    ok = d.steal(v);
+    assert(ok && v == 1);
+    ok = d.pop(v);
+    assert(ok && v == 6);
+    for (long i = 2; i < 6; ++i) {
+        ok = d.steal(v);
+        assert(ok && v == i);
+    }
+    ok = d.pop(v) || d.steal(v);
+    assert(!ok);
+    // 绕环多圈
+    for (long i = 0; i < 100; ++i) {
+        ok = d.push(i) && d.push(i + 1);
+        assert(ok);
+        ok = d.steal(v);
+        assert(ok && v == i);
+        ok = d.pop(v);
+        assert(ok && v == i + 1);
+    }
+    printf("bounds ok\n");
+}
+
+static const int THIEVES = 4;
+static const long TOTAL = 1000000;
+
+struct shared_state {
+    ws_deque<long>* deque;
+    std::atomic<long> taken;
+    std::vector<std::atomic<char>>* seen;
+};
+
+static void take(shared_state* st, long v) {
+    char was = (*st->seen)[v].exchange(1);
+    assert(was == 0);
+    ++st->taken;
+}
+
+static void* thief(void* arg) {
+    shared_state* st = static_cast<shared_state*>(arg);
+    long v;
+    while (st->taken.load() < TOTAL) {
+        if (st->deque->steal(v)) {
+            take(st, v);
+        }
+    }
+    return nullptr;
+}
+
+void test_threads() {
+    ws_deque<long> d(64);   // 容量远小于元素总数, 覆盖队列满时所有者自己取出
+    std::vector<std::atomic<char>> seen(TOTAL);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        seen[i].store(0);
+    }
+    shared_state st;
+    st.deque = &d;
+    st.taken.store(0);
+    st.seen = &seen;
+
+    pthread_t tids[THIEVES];
+    for (int i = 0; i < THIEVES; ++i) {
+        pthread_create(&tids[i], nullptr, thief, &st);
+    }
+    // 所有者每放入3个取出1个, 满时全部取出, 与窃取者争抢最后一个元素
+    long v;
+    for (long i = 0; i < TOTAL; ++i) {
+        if (!d.push(i)) {
+            while (d.pop(v)) {
+                take(&st, v);
+            }
+            bool ok = d.push(i);
+            assert(ok);
+        }
+        if (i % 3 == 2 && d.pop(v)) {
+            take(&st, v);
+        }
+    }
+    while (d.pop(v)) {
+        take(&st, v);
+    }
+    for (int i = 0; i < THIEVES; ++i) {
+        pthread_join(tids[i], nullptr);
+    }
+    assert(st.taken.load() == TOTAL);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        assert(seen[i].load() == 1);
+    }
+    printf("threads ok\n");
+}
+
+int main() {
+    test_bounds();
+    test_threads();
+    return 0;
+}